@@ -0,0 +1,10 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+
+size_t align(size_t size);
+
+#endif /* !ALIGNMENT_H */
@@ -1,19 +1,1585 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alignment.h"
+#include "page_begin.h"
+
+/*
+** Small blocks are carved out of slabs: mappings aligned on their size,
+** SLAB_PAGES pages but at least SLAB_MIN_SIZE, that hold blocks of a
+** single size class behind a header at the slab start.
+** Larger blocks get a mapping of their own with the same header, so the
+** header of any block is found with page_begin(). Headers have pages of
+** their own: a caller overrunning a block never reaches one.
+*/
+#define SLAB_MIN_SIZE ((size_t)64 << 10)
+#define SLAB_PAGES 16
+#define ALIGNMENT sizeof(long double)
+#define SMALL_MAX ((size_t)8192)
+#define CLASS_COUNT 32
+
+/* Thread cache stacks: smaller for the classes past 1 KiB. */
+#define CACHE_SMALL_COUNT 32
+#define CACHE_BIG_COUNT 8
+#define CACHE_BIG_CLASS 20
+
+/* Arenas: ARENAS_PER_CPU per online CPU unless MALLOC_ARENAS says. */
+#define MAX_ARENAS 64
+#define ARENAS_PER_CPU 4
+
+/*
+** Mappings for blocks under the mmap threshold are kept on free, up to
+** SPAN_CACHE_COUNT per arena, for the next block that fits in them.
+*/
+#define MMAP_THRESHOLD ((size_t)128 << 10)
+#define SPAN_CACHE_COUNT 8
+
+/*
+** Empty slabs are kept for any class, up to EMPTY_SLAB_COUNT per arena.
+** Their pages, like those of kept mappings, go back to the kernel once
+** they have been idle for MALLOC_DECAY_MS.
+*/
+#define EMPTY_SLAB_COUNT 16
+#define DECAY_MS 1000
+
+#define SLAB_MAGIC 0x534c4142u
+#define LARGE_MAGIC 0x4c415247u
+
+/*
+** Check mode (MALLOC_CHECK=1): a block holds the caller's bytes, then a
+** canary, and the caller's size in its last word; slabs keep a bitmap
+** of the blocks handed out; free() and realloc() only read the headers
+** of mappings found in a registry. Thread caches and remote frees are
+** bypassed so that every free is checked under its arena lock.
+*/
+#define CHECK_EXTRA (2 * sizeof(size_t))
+#define CANARY ((size_t)0xc0dedbadfeedfaceULL)
+#define REGISTRY_DELETED ((struct slab *)1)
+
+struct free_block
+{
+    struct free_block *next;
+};
+
+struct slab
+{
+    unsigned magic;
+    unsigned class_index;
+    size_t block_size; // size of a block (small) or usable size (large)
+    size_t capacity; // number of blocks in the slab
+    size_t used; // number of blocks handed out
+    char *first; // first block
+    char *bump; // first block never handed out
+    struct free_block *free; // blocks given back
+    struct slab *prev; // neighbours in the arena's list for this class
+    struct slab *next;
+    struct arena *arena; // owner of a small slab
+    struct free_block *remote; // blocks freed from other arenas' threads
+    struct slab *remote_next; // next slab with remote blocks in the arena
+    char *map; // mapping holding a large block
+    size_t map_size;
+    unsigned long idle_since; // when an empty slab or kept mapping was freed
+    int purged; // its pages went back to the kernel since
+    unsigned long handed_out[]; // blocks in use, in check mode
+};
+
+struct arena
+{
+    pthread_mutex_t lock;
+    struct slab *partial[CLASS_COUNT]; // slabs with a block left
+    struct slab *empty; // empty slabs, the last emptied first
+    size_t empty_count;
+    struct slab *remote_slabs; // slabs with remote blocks to put back
+    struct slab *spans; // mappings of freed large blocks kept for reuse
+    size_t span_count;
+    unsigned long decay_due; // next idle slab or mapping to purge, or 0
+    size_t acquired; // lock acquisitions
+    size_t contended; // acquisitions that had to wait
+    size_t slabs[CLASS_COUNT]; // slabs of each class with a block out
+    size_t blocks[CLASS_COUNT]; // blocks out of them, thread caches included
+};
+
+struct thread_cache
+{
+    struct thread_cache *prev; // neighbours in the list of live caches
+    struct thread_cache *next;
+    size_t count[CLASS_COUNT];
+    void *blocks[CACHE_BIG_CLASS * CACHE_SMALL_COUNT
+                 + (CLASS_COUNT - CACHE_BIG_CLASS) * CACHE_BIG_COUNT];
+};
+
+static const size_t class_sizes[CLASS_COUNT] = {
+    16,   32,   48,   64,   80,   96,   112,  128,  160,  192,  224,
+    256,  320,  384,  448,  512,  640,  768,  896,  1024, 1280, 1536,
+    1792, 2048, 2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192,
+};
+
+static struct arena arenas[MAX_ARENAS];
+static unsigned arena_count = 0;
+static unsigned next_arena = 0;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t page_size = 0;
+static size_t slab_size = 0;
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static unsigned long decay_ms = DECAY_MS;
+static char *map_hint = NULL;
+static int check_mode = -1; // -1 until the environment is read
+static int stats_at_exit = 0;
+static size_t large_count = 0; // large mappings, kept ones included
+static size_t large_bytes = 0;
+
+static struct slab **registry = NULL; // headers of live mappings
+static size_t registry_size = 0; // slots, a power of two
+static size_t registry_live = 0;
+static size_t registry_used = 0; // live and deleted slots
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t cache_key;
+static int cache_key_ready = 0;
+static struct thread_cache *caches = NULL; // live caches, under init_lock
+static __thread struct thread_cache *thread_cache
+    __attribute__((tls_model("initial-exec")));
+static __thread int cache_dead __attribute__((tls_model("initial-exec")));
+static __thread struct arena *thread_arena
+    __attribute__((tls_model("initial-exec")));
+
+/*
+** Size class of an aligned size: steps of 16 up to 128, then four
+** classes per power of two.
+*/
+static unsigned class_index(size_t size)
+{
+    if (size <= 128)
+        return size / ALIGNMENT - 1;
+    unsigned lg = sizeof(long) * 8 - 1 - __builtin_clzl(size - 1);
+    size_t step = (size_t)1 << (lg - 2);
+    size_t k = (size - ((size_t)1 << lg) + step - 1) / step;
+    return 8 + 4 * (lg - 7) + k - 1;
+}
+
+static size_t get_page_size(void)
+{
+    if (!page_size)
+        page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+/* A slab spans many pages whatever their size, so its header leaves room. */
+static size_t get_slab_size(void)
+{
+    if (!slab_size)
+    {
+        size_t size = SLAB_PAGES * get_page_size();
+        slab_size = size < SLAB_MIN_SIZE ? SLAB_MIN_SIZE : size;
+    }
+    return slab_size;
+}
+
+static size_t round_up(size_t size, size_t boundary)
+{
+    return (size + boundary - 1) & ~(boundary - 1);
+}
+
+/* Blocks start on the page after their header and its bitmap. */
+static size_t header_size(void)
+{
+    size_t bits = 8 * sizeof(unsigned long);
+    size_t words = (get_slab_size() / ALIGNMENT + bits - 1) / bits;
+    return round_up(sizeof(struct slab) + words * sizeof(unsigned long),
+                    get_page_size());
+}
+
+static struct slab *slab_of(void *ptr)
+{
+    /* A block never starts its mapping: the byte before it is in the
+    ** same slab-sized chunk as the header. */
+    return page_begin((char *)ptr - 1, get_slab_size());
+}
+
+/*
+** Map size bytes at an address aligned on boundary (a power of two, at
+** least the slab size). Try where the last mapping ended first: the kernel
+** usually hands back aligned space there, which avoids trimming.
+*/
+static void *map_aligned(size_t size, size_t boundary)
+{
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    char *last = __atomic_load_n(&map_hint, __ATOMIC_RELAXED);
+    char *hint = NULL;
+    if ((size_t)last > size)
+        hint = page_begin(last - size, boundary);
+    char *p = mmap(hint, size, prot, flags, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    if (page_begin(p, boundary) != p)
+    {
+        munmap(p, size);
+        size_t len = size + boundary - get_page_size();
+        char *raw = mmap(NULL, len, prot, flags, -1, 0);
+        if (raw == MAP_FAILED)
+            return NULL;
+        p = page_begin(raw + boundary - 1, boundary);
+        if (p != raw)
+            munmap(raw, p - raw);
+        if (raw + len != p + size)
+            munmap(p + size, raw + len - (p + size));
+    }
+    __atomic_store_n(&map_hint, p, __ATOMIC_RELAXED);
+    return p;
+}
+
+/*
+** Check mode registry: an open-addressing set of the headers of live
+** slabs and large mappings, all aligned on the slab size. The table is mapped
+** directly so that it never allocates through itself.
+*/
+static size_t registry_slot(struct slab **table, size_t size,
+                            struct slab *header)
+{
+    size_t mask = size - 1;
+    size_t i = (size_t)header / get_slab_size() * (size_t)0x9e3779b97f4a7c15ULL;
+    for (i &= mask; table[i] && table[i] != header; i = (i + 1) & mask)
+        continue;
+    return i;
+}
+
+/* Rehash without the deleted slots, doubling once a quarter is live. */
+static int registry_grow(void)
+{
+    size_t size = registry_size;
+    if (!size)
+        size = get_page_size() / sizeof(struct slab *);
+    else if (registry_live * 4 >= size)
+        size *= 2;
+    struct slab **table = mmap(NULL, size * sizeof(struct slab *),
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+        return 0;
+    for (size_t i = 0; i < registry_size; i++)
+        if (registry[i] && registry[i] != REGISTRY_DELETED)
+            table[registry_slot(table, size, registry[i])] = registry[i];
+    if (registry)
+        munmap(registry, registry_size * sizeof(struct slab *));
+    registry = table;
+    registry_size = size;
+    registry_used = registry_live;
+    return 1;
+}
+
+static int registry_add(struct slab *header)
+{
+    int added = 1;
+    pthread_mutex_lock(&registry_lock);
+    if ((registry_used + 1) * 2 > registry_size)
+        added = registry_grow();
+    if (added)
+    {
+        registry[registry_slot(registry, registry_size, header)] = header;
+        registry_live++;
+        registry_used++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return added;
+}
+
+/* The registry lock is held. */
+static void registry_delete(struct slab *header)
+{
+    size_t i = registry_slot(registry, registry_size, header);
+    if (registry[i])
+    {
+        registry[i] = REGISTRY_DELETED;
+        registry_live--;
+    }
+}
+
+/* Before unmapping: the address may be mapped and registered again. */
+static void registry_remove(struct slab *header)
+{
+    pthread_mutex_lock(&registry_lock);
+    registry_delete(header);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static int registry_has(struct slab *header)
+{
+    pthread_mutex_lock(&registry_lock);
+    int found = registry_size
+        && registry[registry_slot(registry, registry_size, header)];
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+/* Unmap a slab or a large block's mapping, given its header. */
+static void header_unmap(struct slab *header)
+{
+    if (check_mode)
+        registry_remove(header);
+    if (header->magic == LARGE_MAGIC)
+    {
+        __atomic_sub_fetch(&large_count, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&large_bytes, header->map_size, __ATOMIC_RELAXED);
+        munmap(header->map, header->map_size);
+    }
+    else
+        munmap(header, get_slab_size());
+}
+
+static void list_push(struct slab **head, struct slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+static void list_remove(struct slab **head, struct slab *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+static void arenas_init(void)
+{
+    pthread_mutex_lock(&init_lock);
+    if (!__atomic_load_n(&arena_count, __ATOMIC_ACQUIRE))
+    {
+        long count = ARENAS_PER_CPU * sysconf(_SC_NPROCESSORS_ONLN);
+        char *env = getenv("MALLOC_ARENAS");
+        if (env && atol(env) > 0)
+            count = atol(env);
+        if (count < 1)
+            count = 1;
+        if (count > MAX_ARENAS)
+            count = MAX_ARENAS;
+        for (long i = 0; i < count; i++)
+            pthread_mutex_init(&arenas[i].lock, NULL);
+        env = getenv("MALLOC_MMAP_THRESHOLD");
+        if (env && atol(env) > 0)
+            mmap_threshold = atol(env);
+        env = getenv("MALLOC_DECAY_MS");
+        if (env && atol(env) >= 0)
+            decay_ms = atol(env);
+        env = getenv("MALLOC_CHECK");
+        check_mode = env && atol(env) > 0;
+        env = getenv("MALLOC_STATS");
+        stats_at_exit = env && atol(env) > 0;
+        __atomic_store_n(&arena_count, count, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&init_lock);
+}
+
+/* Arenas are handed out round-robin. */
+static struct arena *arena_next(void)
+{
+    unsigned count = __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+    if (!count)
+    {
+        arenas_init();
+        count = arena_count;
+    }
+    unsigned i = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+    return &arenas[i % count];
+}
+
+static struct arena *arena_get(void)
+{
+    if (!thread_arena)
+        thread_arena = arena_next();
+    return thread_arena;
+}
+
+/*
+** Count the acquisitions that had to wait. A thread that waited moves
+** to the next arena for its later refills, so threads spread out until
+** they stop colliding.
+*/
+static void arena_lock(struct arena *arena)
+{
+    if (pthread_mutex_trylock(&arena->lock))
+    {
+        pthread_mutex_lock(&arena->lock);
+        arena->contended++;
+        if (thread_arena == arena)
+            thread_arena = arena_next();
+    }
+    arena->acquired++;
+}
+
+static unsigned long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+/* Give back the pages of an idle slab or mapping, but the header's. */
+static void idle_purge(struct slab *slab)
+{
+    size_t size = slab->magic == LARGE_MAGIC ? slab->map_size : get_slab_size();
+    char *start = (char *)slab + header_size();
+    if (start < (char *)slab + size)
+        madvise(start, (char *)slab + size - start, MADV_DONTNEED);
+    slab->purged = 1;
+}
+
+/* Start the decay clock of a slab or mapping that just became idle. */
+static void idle_start(struct arena *arena, struct slab *slab)
+{
+    slab->purged = 0;
+    slab->idle_since = now_ms();
+    if (!decay_ms)
+    {
+        idle_purge(slab);
+        return;
+    }
+    unsigned long due = slab->idle_since + decay_ms;
+    if (!arena->decay_due || due < arena->decay_due)
+        arena->decay_due = due;
+}
+
+/*
+** Purge what has been idle for decay_ms; the arena lock is held. This
+** runs on refills, flushes and large frees, and walks the idle lists
+** only once something is due.
+*/
+static void arena_decay(struct arena *arena)
+{
+    if (!arena->decay_due)
+        return;
+    unsigned long now = now_ms();
+    if (now < arena->decay_due)
+        return;
+    arena->decay_due = 0;
+    struct slab *lists[] = { arena->empty, arena->spans };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(*lists); i++)
+        for (struct slab *slab = lists[i]; slab; slab = slab->next)
+        {
+            unsigned long due = slab->idle_since + decay_ms;
+            if (slab->purged)
+                continue;
+            if (due <= now)
+                idle_purge(slab);
+            else if (!arena->decay_due || due < arena->decay_due)
+                arena->decay_due = due;
+        }
+}
+
+/* Set up a slab for a class, reusing the arena's last emptied slab. */
+static struct slab *slab_create(struct arena *arena, unsigned index)
+{
+    struct slab *slab = arena->empty;
+    if (slab)
+    {
+        list_remove(&arena->empty, slab);
+        arena->empty_count--;
+    }
+    else
+    {
+        slab = map_aligned(get_slab_size(), get_slab_size());
+        if (slab && check_mode && !registry_add(slab))
+        {
+            munmap(slab, get_slab_size());
+            return NULL;
+        }
+    }
+    if (!slab)
+        return NULL;
+    slab->magic = SLAB_MAGIC;
+    slab->class_index = index;
+    slab->arena = arena;
+    slab->block_size = class_sizes[index];
+    slab->first = (char *)slab + header_size();
+    slab->capacity =
+        ((char *)slab + get_slab_size() - slab->first) / slab->block_size;
+    if (!slab->capacity)
+    {
+        /* Not with SLAB_PAGES pages; fail rather than loop on slabs. */
+        header_unmap(slab);
+        return NULL;
+    }
+    slab->bump = slab->first;
+    slab->free = NULL;
+    arena->slabs[index]++;
+    return slab;
+}
+
+static void check_fail(const char *call, const char *error, void *ptr)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%s(): %s: %p\n", call, error, ptr);
+    if (write(STDERR_FILENO, line, len) < 0)
+        abort();
+    abort();
+}
+
+/* Whether ptr starts a block that was handed out at some point. */
+static int block_valid(struct slab *slab, char *ptr)
+{
+    return ptr >= slab->first && ptr < slab->bump
+        && (size_t)(ptr - slab->first) % slab->block_size == 0;
+}
+
+/* Flip a block's bit in check mode; returns whether it was set. */
+static int block_toggle(struct slab *slab, void *block)
+{
+    size_t n = ((char *)block - slab->first) / slab->block_size;
+    unsigned long bit = 1UL << n % (8 * sizeof(unsigned long));
+    unsigned long *word = slab->handed_out + n / (8 * sizeof(unsigned long));
+    *word ^= bit;
+    return !(*word & bit);
+}
+
+/* Take a block from a slab that has one left. */
+static void *slab_take(struct slab *slab)
+{
+    void *block;
+    if (slab->free)
+    {
+        block = slab->free;
+        if (check_mode && !block_valid(slab, block))
+            check_fail("malloc", "corrupted free list", block);
+        slab->free = slab->free->next;
+    }
+    else
+    {
+        block = slab->bump;
+        slab->bump += slab->block_size;
+    }
+    if (check_mode)
+        block_toggle(slab, block);
+    slab->used++;
+    return block;
+}
+
+/* Start of the block holding ptr (memalign hands out interior pointers). */
+static char *block_start(struct slab *slab, void *ptr)
+{
+    size_t offset = (char *)ptr - slab->first;
+    return slab->first + offset - offset % slab->block_size;
+}
+
+/* Give a block back to its slab; the arena lock is held. */
+static void slab_put(struct slab *slab, void *ptr)
+{
+    struct arena *arena = slab->arena;
+    struct free_block *block = ptr;
+    unsigned index = slab->class_index;
+    if (check_mode && !block_toggle(slab, block))
+        check_fail("free", "double free", block);
+    if (slab->used == slab->capacity)
+        list_push(&arena->partial[index], slab);
+    block->next = slab->free;
+    slab->free = block;
+    arena->blocks[index]--;
+    if (--slab->used == 0)
+    {
+        list_remove(&arena->partial[index], slab);
+        arena->slabs[index]--;
+        if (arena->empty_count == EMPTY_SLAB_COUNT)
+            header_unmap(slab);
+        else
+        {
+            list_push(&arena->empty, slab);
+            arena->empty_count++;
+            idle_start(arena, slab);
+        }
+    }
+}
+
+/*
+** Free from a thread working in another arena: one CAS on the slab's
+** list and no lock. The block that makes the list non-empty also queues
+** the slab on its arena, whose next refill or flush drains the lists.
+*/
+static void remote_free(struct slab *slab, struct free_block *block)
+{
+    struct free_block *head = __atomic_load_n(&slab->remote, __ATOMIC_RELAXED);
+    do
+        block->next = head;
+    while (!__atomic_compare_exchange_n(&slab->remote, &head, block, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (head)
+        return;
+    struct arena *arena = slab->arena;
+    struct slab *first =
+        __atomic_load_n(&arena->remote_slabs, __ATOMIC_RELAXED);
+    do
+        slab->remote_next = first;
+    while (!__atomic_compare_exchange_n(&arena->remote_slabs, &first, slab, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+** Put the remotely freed blocks back in their slabs; the arena lock is
+** held. remote_next is read before the slab's list is emptied, since a
+** new remote free may queue the slab again right after.
+*/
+static void arena_drain(struct arena *arena)
+{
+    if (!__atomic_load_n(&arena->remote_slabs, __ATOMIC_RELAXED))
+        return;
+    struct slab *slab =
+        __atomic_exchange_n(&arena->remote_slabs, NULL, __ATOMIC_ACQUIRE);
+    while (slab)
+    {
+        struct slab *next = slab->remote_next;
+        struct free_block *block =
+            __atomic_exchange_n(&slab->remote, NULL, __ATOMIC_ACQUIRE);
+        while (block)
+        {
+            struct free_block *following = block->next;
+            slab_put(slab, block);
+            block = following;
+        }
+        slab = next;
+    }
+}
+
+/*
+** Give back block starts, each to the arena owning its slab. Blocks
+** freed together mostly come from one arena: its lock is kept across
+** a run of them.
+*/
+static void arena_give(void **blocks, size_t count)
+{
+    struct arena *locked = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        struct slab *slab = slab_of(blocks[i]);
+        if (slab->arena != locked)
+        {
+            if (locked)
+                pthread_mutex_unlock(&locked->lock);
+            locked = slab->arena;
+            arena_lock(locked);
+            arena_drain(locked);
+            arena_decay(locked);
+        }
+        slab_put(slab, blocks[i]);
+    }
+    if (locked)
+        pthread_mutex_unlock(&locked->lock);
+}
+
+/* Take up to count blocks of a class, under a single lock. */
+static size_t arena_take(struct arena *arena, unsigned index, void **blocks,
+                         size_t count)
+{
+    size_t taken = 0;
+    arena_lock(arena);
+    arena_drain(arena);
+    arena_decay(arena);
+    while (taken < count)
+    {
+        struct slab *slab = arena->partial[index];
+        if (!slab)
+        {
+            slab = slab_create(arena, index);
+            if (!slab)
+                break;
+            list_push(&arena->partial[index], slab);
+        }
+        while (taken < count && slab->used < slab->capacity)
+            blocks[taken++] = slab_take(slab);
+        if (slab->used == slab->capacity)
+            list_remove(&arena->partial[index], slab);
+    }
+    arena->blocks[index] += taken;
+    pthread_mutex_unlock(&arena->lock);
+    return taken;
+}
+
+/*
+** Per-thread stacks of free block starts, one per class, so that most
+** malloc() and free() calls take no lock. They live out of the blocks
+** themselves and move to and from the arena half a stack at a time.
+*/
+static size_t cache_capacity(unsigned index)
+{
+    return index < CACHE_BIG_CLASS ? CACHE_SMALL_COUNT : CACHE_BIG_COUNT;
+}
+
+static size_t cache_offset(unsigned index)
+{
+    if (index < CACHE_BIG_CLASS)
+        return index * CACHE_SMALL_COUNT;
+    return CACHE_BIG_CLASS * CACHE_SMALL_COUNT
+        + (index - CACHE_BIG_CLASS) * CACHE_BIG_COUNT;
+}
+
+static struct thread_cache *cache_get(void)
+{
+    struct thread_cache *cache = thread_cache;
+    if (cache || cache_dead || !cache_key_ready || check_mode)
+        return cache;
+    unsigned index = class_index(align(sizeof(struct thread_cache)));
+    if (!arena_take(arena_get(), index, (void **)&cache, 1))
+        return NULL;
+    memset(cache, 0, sizeof(struct thread_cache));
+    pthread_mutex_lock(&init_lock);
+    cache->next = caches;
+    if (caches)
+        caches->prev = cache;
+    caches = cache;
+    pthread_mutex_unlock(&init_lock);
+    thread_cache = cache;
+    pthread_setspecific(cache_key, cache);
+    return cache;
+}
+
+static void *cache_pop(struct thread_cache *cache, unsigned index)
+{
+    void **stack = cache->blocks + cache_offset(index);
+    if (!cache->count[index])
+    {
+        size_t half = cache_capacity(index) / 2;
+        cache->count[index] = arena_take(arena_get(), index, stack, half);
+        if (!cache->count[index])
+            return NULL;
+    }
+    return stack[--cache->count[index]];
+}
+
+static void cache_push(struct thread_cache *cache, unsigned index, void *block)
+{
+    void **stack = cache->blocks + cache_offset(index);
+    size_t capacity = cache_capacity(index);
+    if (cache->count[index] == capacity)
+    {
+        /* Flush the coldest half and keep the recently freed blocks. */
+        size_t half = capacity / 2;
+        arena_give(stack, half);
+        memmove(stack, stack + half, (capacity - half) * sizeof(void *));
+        cache->count[index] -= half;
+    }
+    stack[cache->count[index]++] = block;
+}
+
+/* TLS destructor: the exiting thread gives every cached block back. */
+static void cache_flush(struct thread_cache *cache)
+{
+    for (unsigned index = 0; index < CLASS_COUNT; index++)
+    {
+        arena_give(cache->blocks + cache_offset(index), cache->count[index]);
+        cache->count[index] = 0;
+    }
+}
+
+static void cache_destroy(void *arg)
+{
+    struct thread_cache *cache = arg;
+    pthread_mutex_lock(&init_lock);
+    if (cache->prev)
+        cache->prev->next = cache->next;
+    else
+        caches = cache->next;
+    if (cache->next)
+        cache->next->prev = cache->prev;
+    pthread_mutex_unlock(&init_lock);
+    thread_cache = NULL;
+    cache_dead = 1;
+    cache_flush(arg);
+    arena_give(&arg, 1);
+}
+
+static void *small_alloc(unsigned index)
+{
+    struct thread_cache *cache = cache_get();
+    if (cache)
+        return cache_pop(cache, index);
+    void *block;
+    return arena_take(arena_get(), index, &block, 1) ? block : NULL;
+}
+
+static void small_free(struct slab *slab, void *ptr)
+{
+    void *block = block_start(slab, ptr);
+    if (slab->arena != thread_arena && !check_mode)
+    {
+        remote_free(slab, block);
+        return;
+    }
+    struct thread_cache *cache = cache_get();
+    if (cache)
+        cache_push(cache, slab->class_index, block);
+    else
+        arena_give(&block, 1);
+}
+
+/*
+** A large block starts past the header, or at the first aligned address
+** past it; for alignments of a slab size and more, the header goes in the
+** chunk just before the block so that slab_of() still finds it.
+*/
+static void *large_map(size_t size, size_t alignment)
+{
+    size_t offset = alignment >= get_slab_size()
+        ? alignment
+        : round_up(header_size(), alignment);
+    if (size > (size_t)-1 - offset - get_slab_size())
+        return NULL;
+    size_t map_size = round_up(offset + size, get_page_size());
+    size_t boundary = alignment > get_slab_size() ? alignment : get_slab_size();
+    char *map = map_aligned(map_size, boundary);
+    if (!map)
+        return NULL;
+    char *ptr = map + offset;
+    struct slab *slab = slab_of(ptr);
+    if (check_mode && !registry_add(slab))
+    {
+        munmap(map, map_size);
+        return NULL;
+    }
+    slab->magic = LARGE_MAGIC;
+    slab->block_size = map + map_size - ptr;
+    slab->used = 1;
+    slab->map = map;
+    slab->map_size = map_size;
+    __atomic_add_fetch(&large_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&large_bytes, map_size, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/* Best-fitting kept mapping, if one wastes at most a quarter of itself. */
+static void *span_reuse(struct arena *arena, size_t size)
+{
+    struct slab *best = NULL;
+    arena_lock(arena);
+    for (struct slab *span = arena->spans; span; span = span->next)
+        if (span->block_size >= size
+            && span->block_size - size <= span->block_size / 4
+            && (!best || span->block_size < best->block_size))
+            best = span;
+    if (best)
+    {
+        list_remove(&arena->spans, best);
+        arena->span_count--;
+        best->used = 1;
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return best ? best->map + header_size() : NULL;
+}
+
+/* fresh is set when the block comes from a new mapping, hence zeroed. */
+static void *large_alloc(size_t size, size_t alignment, int *fresh)
+{
+    *fresh = 0;
+    if (alignment == ALIGNMENT && size < mmap_threshold)
+    {
+        void *ptr = span_reuse(arena_get(), size);
+        if (ptr)
+            return ptr;
+    }
+    *fresh = 1;
+    return large_map(size, alignment);
+}
+
+static void large_free(struct slab *slab)
+{
+    char *ptr = slab->map + header_size();
+    slab->used = 0;
+    if (slab->block_size < mmap_threshold && slab_of(ptr) == slab)
+    {
+        struct arena *arena = arena_get();
+        arena_lock(arena);
+        int kept = arena->span_count < SPAN_CACHE_COUNT;
+        if (kept)
+        {
+            slab->block_size = slab->map + slab->map_size - ptr;
+            list_push(&arena->spans, slab);
+            arena->span_count++;
+            idle_start(arena, slab);
+        }
+        arena_decay(arena);
+        pthread_mutex_unlock(&arena->lock);
+        if (kept)
+            return;
+    }
+    header_unmap(slab);
+}
+
+/*
+** A kept mapping right after a growing block is merged into it: drop
+** it from the cache and unmap it so that mremap() can grow in place.
+*/
+static void span_absorb(char *end)
+{
+    struct arena *arena = arena_get();
+    struct slab *span;
+    arena_lock(arena);
+    for (span = arena->spans; span && span->map != end; span = span->next)
+        continue;
+    if (span)
+    {
+        list_remove(&arena->spans, span);
+        arena->span_count--;
+    }
+    pthread_mutex_unlock(&arena->lock);
+    if (span)
+        header_unmap(span);
+}
+
+/*
+** Resize a large block's mapping without copying: in place when the
+** pages after it are free, else by moving its pages onto a fresh aligned
+** reservation. Shrinking always happens in place.
+*/
+static void *large_resize(struct slab *slab, void *ptr, size_t size)
+{
+    size_t offset = (char *)ptr - slab->map;
+    if (size > (size_t)-1 - offset - get_slab_size())
+        return NULL;
+    size_t map_size = round_up(offset + size, get_page_size());
+    if (map_size == slab->map_size)
+        return ptr;
+    if (map_size > slab->map_size)
+        span_absorb(slab->map + slab->map_size);
+    char *map = mremap(slab->map, slab->map_size, map_size, 0);
+    if (map == MAP_FAILED)
+    {
+        map = map_aligned(map_size, get_slab_size());
+        if (!map)
+            return NULL;
+        struct slab *moved = slab_of(map + offset);
+        if (check_mode && !registry_add(moved))
+        {
+            munmap(map, map_size);
+            return NULL;
+        }
+        /* The old pages are unmapped by the move: drop their header
+        ** before another thread can register it again. */
+        if (check_mode)
+            pthread_mutex_lock(&registry_lock);
+        int failed = mremap(slab->map, slab->map_size, map_size,
+                            MREMAP_MAYMOVE | MREMAP_FIXED, map)
+            == MAP_FAILED;
+        if (check_mode)
+        {
+            registry_delete(failed ? moved : slab);
+            pthread_mutex_unlock(&registry_lock);
+        }
+        if (failed)
+        {
+            munmap(map, map_size);
+            return NULL;
+        }
+    }
+    ptr = map + offset;
+    slab = slab_of(ptr);
+    __atomic_add_fetch(&large_bytes, map_size - slab->map_size,
+                       __ATOMIC_RELAXED);
+    slab->map = map;
+    slab->map_size = map_size;
+    slab->block_size = map + map_size - (char *)ptr;
+    return ptr;
+}
+
+/*
+** Shared by every entry point. Going through malloc() instead would let
+** the compiler fold calloc() into a call to itself. Small blocks are
+** never reported fresh: zeroing at most SMALL_MAX bytes costs less than
+** bypassing the thread cache to learn where a block came from.
+*/
+static void *allocate_fresh(size_t size, int *fresh)
+{
+    size_t aligned = align(size ? size : 1);
+    void *ptr = NULL;
+    *fresh = 0;
+    if (aligned && aligned <= SMALL_MAX)
+        ptr = small_alloc(class_index(aligned));
+    else if (aligned)
+        ptr = large_alloc(aligned, ALIGNMENT, fresh);
+    if (!ptr)
+        errno = ENOMEM;
+    return ptr;
+}
+
+static void *allocate(size_t size)
+{
+    int fresh;
+    return allocate_fresh(size, &fresh);
+}
+
+static void *aligned_block(size_t alignment, size_t size)
+{
+    if (alignment <= ALIGNMENT)
+        return allocate(size);
+    size_t padded = align(size ? size : 1);
+    if (!padded)
+        return NULL;
+    if (alignment < SMALL_MAX && padded <= SMALL_MAX - alignment)
+    {
+        char *block = allocate(padded + alignment - ALIGNMENT);
+        if (!block)
+            return NULL;
+        return (char *)round_up((size_t)block, alignment);
+    }
+    int fresh;
+    return large_alloc(padded, alignment, &fresh);
+}
+
+static size_t block_usable(void *ptr)
+{
+    struct slab *slab = slab_of(ptr);
+    if (slab->magic == LARGE_MAGIC)
+        return slab->map + slab->map_size - (char *)ptr;
+    return block_start(slab, ptr) + slab->block_size - (char *)ptr;
+}
+
+static void release(void *ptr)
+{
+    struct slab *slab = slab_of(ptr);
+    if (slab->magic == LARGE_MAGIC)
+        large_free(slab);
+    else
+        small_free(slab, ptr);
+}
+
+/* Callers test check_mode first, so this only runs before init or on. */
+static int check_on(void)
+{
+    if (check_mode < 0)
+        arenas_init();
+    return check_mode;
+}
+
+/* Room for the canary and the size; overflows to a failing size. */
+static size_t check_size(size_t size)
+{
+    return size > (size_t)-1 - CHECK_EXTRA ? (size_t)-1 : size + CHECK_EXTRA;
+}
+
+static void *check_arm(void *ptr, size_t size)
+{
+    if (!ptr)
+        return NULL;
+    char *end = (char *)ptr + block_usable(ptr);
+    size_t canary = CANARY ^ (size_t)ptr;
+    memcpy((char *)ptr + size, &canary, sizeof(canary));
+    memcpy(end - sizeof(size), &size, sizeof(size));
+    return ptr;
+}
+
+/*
+** Validate a block given back by the caller and return its size. The
+** header is only read once the registry knows it; the double free test
+** is repeated under the arena lock by slab_put().
+*/
+static size_t check_block(void *ptr, const char *call)
+{
+    struct slab *slab = slab_of(ptr);
+    if (!registry_has(slab))
+        check_fail(call, "invalid pointer", ptr);
+    char *end;
+    if (slab->magic == LARGE_MAGIC)
+    {
+        end = slab->map + slab->map_size;
+        if ((char *)ptr != end - slab->block_size)
+            check_fail(call, "invalid pointer", ptr);
+        if (!slab->used)
+            check_fail(call, "double free", ptr);
+    }
+    else
+    {
+        char *start = (char *)ptr < slab->first ? NULL : block_start(slab, ptr);
+        if (!start || !block_valid(slab, start))
+            check_fail(call, "invalid pointer", ptr);
+        size_t n = (start - slab->first) / slab->block_size;
+        if (!(slab->handed_out[n / (8 * sizeof(unsigned long))]
+              & 1UL << n % (8 * sizeof(unsigned long))))
+            check_fail(call, "double free", ptr);
+        end = start + slab->block_size;
+    }
+    size_t size;
+    size_t canary;
+    memcpy(&size, end - sizeof(size), sizeof(size));
+    if (size > (size_t)(end - (char *)ptr) - CHECK_EXTRA)
+        check_fail(call, "corrupted size", ptr);
+    memcpy(&canary, (char *)ptr + size, sizeof(canary));
+    if (canary != (CANARY ^ (size_t)ptr))
+        check_fail(call, "buffer overflow", ptr);
+    return size;
+}
+
+static void *check_alloc(size_t size)
+{
+    return check_arm(allocate(check_size(size)), size);
+}
+
+static void *memalign_block(size_t alignment, size_t size)
+{
+    if (check_mode && check_on())
+        return check_arm(aligned_block(alignment, check_size(size)), size);
+    return aligned_block(alignment, size);
+}
+
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&init_lock);
+    for (unsigned i = 0; i < arena_count; i++)
+        pthread_mutex_lock(&arenas[i].lock);
+    pthread_mutex_lock(&registry_lock);
+}
+
+static void fork_release(void)
+{
+    pthread_mutex_unlock(&registry_lock);
+    for (unsigned i = 0; i < arena_count; i++)
+        pthread_mutex_unlock(&arenas[i].lock);
+    pthread_mutex_unlock(&init_lock);
+}
+
+__attribute__((constructor)) static void malloc_init(void)
+{
+    if (!arena_count)
+        arenas_init();
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+    cache_key_ready = !pthread_key_create(&cache_key, cache_destroy);
+}
 
 __attribute__((visibility("default"))) void *malloc(size_t size)
 {
-    return NULL;
+    if (check_mode && check_on())
+        return check_alloc(size);
+    return allocate(size);
 }
 
 __attribute__((visibility("default"))) void free(void *ptr)
-{}
+{
+    if (!ptr)
+        return;
+    if (check_mode)
+        check_block(ptr, "free");
+    release(ptr);
+}
+
+__attribute__((visibility("default"))) size_t malloc_usable_size(void *ptr)
+{
+    if (!ptr)
+        return 0;
+    if (check_mode)
+        return check_block(ptr, "malloc_usable_size");
+    return block_usable(ptr);
+}
+
+/* realloc() of a live block to a non-zero size. */
+static void *resize(void *ptr, size_t size)
+{
+    size_t usable = block_usable(ptr);
+    struct slab *slab = slab_of(ptr);
+    int large = slab->magic == LARGE_MAGIC;
+    /* Blocks stay put unless a shrink would leave most of them unused:
+    ** the class slack absorbs growth one element at a time. */
+    if (size <= usable && (size > usable / 2 || (large && size > SMALL_MAX)))
+    {
+        if (large)
+            large_resize(slab, ptr, size); // shrinks in place or not at all
+        return ptr;
+    }
+    if (large && size > SMALL_MAX)
+    {
+        void *new_ptr = large_resize(slab, ptr, size);
+        if (!new_ptr)
+            errno = ENOMEM;
+        return new_ptr;
+    }
+    void *new_ptr = allocate(size);
+    if (!new_ptr)
+        return NULL;
+    memcpy(new_ptr, ptr, size < usable ? size : usable);
+    release(ptr);
+    return new_ptr;
+}
+
+/* The canary and size are written again wherever the block ends up. */
+static void *check_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return check_alloc(size);
+    check_block(ptr, "realloc");
+    if (!size)
+    {
+        release(ptr);
+        return NULL;
+    }
+    return check_arm(resize(ptr, check_size(size)), size);
+}
 
 __attribute__((visibility("default"))) void *realloc(void *ptr, size_t size)
 {
-    return NULL;
+    if (check_mode && check_on())
+        return check_realloc(ptr, size);
+    if (!ptr)
+        return allocate(size);
+    if (!size)
+    {
+        release(ptr);
+        return NULL;
+    }
+    return resize(ptr, size);
+}
+
+/* Checked nmemb * size, as in beware_overflow(). */
+static int multiply_overflows(size_t nmemb, size_t size, size_t *total)
+{
+    *total = nmemb * size;
+    return nmemb != 0 && *total / nmemb != size;
 }
 
+/*
+** Anonymous mappings come zeroed from the kernel: a new one is left as
+** is, which spares touching (and committing) every page of it.
+*/
 __attribute__((visibility("default"))) void *calloc(size_t nmemb, size_t size)
 {
-    return NULL;
+    size_t total;
+    if (multiply_overflows(nmemb, size, &total))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    int fresh;
+    int checked = check_mode && check_on();
+    void *ptr = allocate_fresh(checked ? check_size(total) : total, &fresh);
+    if (ptr && !fresh)
+        memset(ptr, 0, total);
+    return checked ? check_arm(ptr, total) : ptr;
+}
+
+__attribute__((visibility("default"))) int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (!alignment || alignment % sizeof(void *)
+        || (alignment & (alignment - 1)))
+        return EINVAL;
+    void *ptr = memalign_block(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+__attribute__((visibility("default"))) void *memalign(size_t alignment,
+                                                      size_t size)
+{
+    if (!alignment || (alignment & (alignment - 1)))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *ptr = memalign_block(alignment, size);
+    if (!ptr)
+        errno = ENOMEM;
+    return ptr;
+}
+
+__attribute__((visibility("default"))) void *aligned_alloc(size_t alignment,
+                                                           size_t size)
+{
+    return memalign(alignment, size);
+}
+
+__attribute__((visibility("default"))) void *valloc(size_t size)
+{
+    return memalign(get_page_size(), size);
+}
+
+__attribute__((visibility("default"))) void *pvalloc(size_t size)
+{
+    size_t rounded = round_up(size, get_page_size());
+    if (rounded < size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(get_page_size(), rounded);
+}
+
+/* Blocks of a class, in bytes: out of the arenas or free in their slabs. */
+struct class_stats
+{
+    size_t slabs;
+    size_t in_use; // thread caches excluded
+    size_t free;
+    size_t cached; // in thread caches
+};
+
+struct heap_stats
+{
+    struct class_stats classes[CLASS_COUNT];
+    size_t empty_slabs; // kept for any class
+    size_t empty_purged; // of which purged
+    size_t large_count; // live large blocks
+    size_t large_bytes;
+    size_t span_count; // mappings kept for reuse
+    size_t span_bytes;
+    size_t span_purged; // bytes of them given back to the kernel
+    size_t acquired[MAX_ARENAS];
+    size_t contended[MAX_ARENAS];
+};
+
+/*
+** Snapshot of the heap, taking each arena lock in turn. Other threads'
+** cache counts are read without their owner's knowledge: they are exact
+** once those threads are idle.
+*/
+static void stats_collect(struct heap_stats *stats)
+{
+    size_t blocks[CLASS_COUNT] = { 0 };
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned i = 0; i < arena_count; i++)
+    {
+        struct arena *arena = &arenas[i];
+        pthread_mutex_lock(&arena->lock);
+        for (unsigned index = 0; index < CLASS_COUNT; index++)
+        {
+            stats->classes[index].slabs += arena->slabs[index];
+            blocks[index] += arena->blocks[index];
+        }
+        for (struct slab *slab = arena->empty; slab; slab = slab->next)
+        {
+            stats->empty_slabs++;
+            stats->empty_purged += slab->purged;
+        }
+        for (struct slab *span = arena->spans; span; span = span->next)
+        {
+            stats->span_count++;
+            stats->span_bytes += span->map_size;
+            if (span->purged)
+                stats->span_purged += span->map_size - header_size();
+        }
+        stats->acquired[i] = arena->acquired;
+        stats->contended[i] = arena->contended;
+        pthread_mutex_unlock(&arena->lock);
+    }
+    pthread_mutex_lock(&init_lock);
+    for (struct thread_cache *cache = caches; cache; cache = cache->next)
+        for (unsigned index = 0; index < CLASS_COUNT; index++)
+            stats->classes[index].cached +=
+                __atomic_load_n(&cache->count[index], __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&init_lock);
+    size_t capacity = get_slab_size() - header_size();
+    for (unsigned index = 0; index < CLASS_COUNT; index++)
+    {
+        struct class_stats *class = &stats->classes[index];
+        size_t size = class_sizes[index];
+        if (class->cached > blocks[index])
+            class->cached = blocks[index];
+        class->in_use = (blocks[index] - class->cached) * size;
+        class->free = (class->slabs * (capacity / size) - blocks[index]) * size;
+        class->cached *= size;
+    }
+    /* Kept mappings are counted as large ones until unmapped. */
+    size_t count = __atomic_load_n(&large_count, __ATOMIC_RELAXED);
+    size_t bytes = __atomic_load_n(&large_bytes, __ATOMIC_RELAXED);
+    stats->large_count = count > stats->span_count ? count - stats->span_count
+                                                   : 0;
+    stats->large_bytes = bytes > stats->span_bytes ? bytes - stats->span_bytes
+                                                   : 0;
+}
+
+static void stats_line(const char *format, ...)
+{
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0 && write(STDERR_FILENO, line, len) < 0)
+        return;
+}
+
+/*
+** Per-class usage, idle memory and the lock traffic of each arena, on
+** stderr. Many contended acquisitions mean MALLOC_ARENAS should be
+** raised; much free or cached memory in a class means fragmentation.
+*/
+__attribute__((visibility("default"))) void malloc_stats(void)
+{
+    struct heap_stats stats;
+    stats_collect(&stats);
+    size_t in_use = 0;
+    size_t system = 0;
+    stats_line("%5s %6s %12s %12s %12s\n", "size", "slabs", "in use", "free",
+               "cached");
+    for (unsigned index = 0; index < CLASS_COUNT; index++)
+    {
+        struct class_stats *class = &stats.classes[index];
+        in_use += class->in_use;
+        system += class->slabs * get_slab_size();
+        if (class->slabs)
+            stats_line("%5zu %6zu %12zu %12zu %12zu\n", class_sizes[index],
+                       class->slabs, class->in_use, class->free,
+                       class->cached);
+    }
+    stats_line("Empty slabs: %zu (%zu bytes), %zu purged\n",
+               stats.empty_slabs, stats.empty_slabs * get_slab_size(),
+               stats.empty_purged);
+    stats_line("Large blocks: %zu (%zu bytes)\n", stats.large_count,
+               stats.large_bytes);
+    stats_line("Kept mappings: %zu (%zu bytes), %zu bytes purged\n",
+               stats.span_count, stats.span_bytes, stats.span_purged);
+    system += stats.empty_slabs * get_slab_size() + stats.large_bytes
+        + stats.span_bytes;
+    stats_line("Total: system bytes %zu, in use bytes %zu\n", system,
+               in_use + stats.large_bytes);
+    for (unsigned i = 0; i < arena_count; i++)
+        stats_line("Arena %u: locked %zu times, %zu contended\n", i,
+                   stats.acquired[i], stats.contended[i]);
+}
+
+/*
+** glibc's fields, mapped onto this heap: the arena is the slabs, the
+** fast bins are the thread caches, mmapped regions are the large blocks,
+** and keepcost is what malloc_trim() would give back.
+*/
+__attribute__((visibility("default"))) struct mallinfo2 mallinfo2(void)
+{
+    struct heap_stats stats;
+    struct mallinfo2 info;
+    stats_collect(&stats);
+    memset(&info, 0, sizeof(info));
+    for (unsigned index = 0; index < CLASS_COUNT; index++)
+    {
+        struct class_stats *class = &stats.classes[index];
+        info.arena += class->slabs * get_slab_size();
+        info.ordblks += class->free / class_sizes[index];
+        info.smblks += class->cached / class_sizes[index];
+        info.fsmblks += class->cached;
+        info.uordblks += class->in_use;
+        info.fordblks += class->free + class->cached;
+    }
+    info.arena += stats.empty_slabs * get_slab_size();
+    info.fordblks += stats.empty_slabs * get_slab_size();
+    info.hblks = stats.large_count + stats.span_count;
+    info.hblkhd = stats.large_bytes + stats.span_bytes;
+    info.keepcost = stats.empty_slabs * get_slab_size() + stats.span_bytes;
+    return info;
+}
+
+static int saturate(size_t value)
+{
+    return value > INT_MAX ? INT_MAX : (int)value;
+}
+
+/* The int version, saturating where glibc would wrap. */
+__attribute__((visibility("default"))) struct mallinfo mallinfo(void)
+{
+    struct mallinfo2 wide = mallinfo2();
+    struct mallinfo info;
+    info.arena = saturate(wide.arena);
+    info.ordblks = saturate(wide.ordblks);
+    info.smblks = saturate(wide.smblks);
+    info.hblks = saturate(wide.hblks);
+    info.hblkhd = saturate(wide.hblkhd);
+    info.usmblks = saturate(wide.usmblks);
+    info.fsmblks = saturate(wide.fsmblks);
+    info.uordblks = saturate(wide.uordblks);
+    info.fordblks = saturate(wide.fordblks);
+    info.keepcost = saturate(wide.keepcost);
+    return info;
+}
+
+/*
+** The same figures as malloc_stats(), as XML in the spirit of glibc's.
+** The snapshot is taken before printing, since stream may allocate.
+*/
+__attribute__((visibility("default"))) int malloc_info(int options,
+                                                       FILE *stream)
+{
+    if (options)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    struct heap_stats stats;
+    stats_collect(&stats);
+    fprintf(stream, "<malloc version=\"1\">\n");
+    for (unsigned index = 0; index < CLASS_COUNT; index++)
+    {
+        struct class_stats *class = &stats.classes[index];
+        if (class->slabs)
+            fprintf(stream,
+                    "<class size=\"%zu\" slabs=\"%zu\" in_use=\"%zu\" "
+                    "free=\"%zu\" cached=\"%zu\"/>\n",
+                    class_sizes[index], class->slabs, class->in_use,
+                    class->free, class->cached);
+    }
+    fprintf(stream, "<empty count=\"%zu\" size=\"%zu\" purged=\"%zu\"/>\n",
+            stats.empty_slabs, stats.empty_slabs * get_slab_size(),
+            stats.empty_purged);
+    fprintf(stream, "<large count=\"%zu\" size=\"%zu\"/>\n",
+            stats.large_count, stats.large_bytes);
+    fprintf(stream, "<kept count=\"%zu\" size=\"%zu\" purged=\"%zu\"/>\n",
+            stats.span_count, stats.span_bytes, stats.span_purged);
+    for (unsigned i = 0; i < arena_count; i++)
+        fprintf(stream,
+                "<arena index=\"%u\" locked=\"%zu\" contended=\"%zu\"/>\n",
+                i, stats.acquired[i], stats.contended[i]);
+    fprintf(stream, "</malloc>\n");
+    return 0;
+}
+
+/*
+** Flush the calling thread's cache, then unmap every empty slab and kept
+** mapping at once instead of waiting for them to decay. Returns 1 when
+** memory went back to the kernel. pad is accepted for glibc's signature
+** only: nothing else is held back.
+*/
+__attribute__((visibility("default"))) int malloc_trim(size_t pad)
+{
+    (void)pad;
+    if (thread_cache)
+        cache_flush(thread_cache);
+    int released = 0;
+    for (unsigned i = 0; i < arena_count; i++)
+    {
+        struct arena *arena = &arenas[i];
+        pthread_mutex_lock(&arena->lock);
+        arena_drain(arena);
+        struct slab *lists[] = { arena->empty, arena->spans };
+        arena->empty = NULL;
+        arena->empty_count = 0;
+        arena->spans = NULL;
+        arena->span_count = 0;
+        pthread_mutex_unlock(&arena->lock);
+        for (size_t j = 0; j < sizeof(lists) / sizeof(*lists); j++)
+            while (lists[j])
+            {
+                struct slab *slab = lists[j];
+                lists[j] = slab->next;
+                header_unmap(slab);
+                released = 1;
+            }
+    }
+    return released;
+}
+
+/* MALLOC_STATS=1: report once the program is done with the heap. */
+__attribute__((destructor)) static void malloc_fini(void)
+{
+    if (stats_at_exit)
+        malloc_stats();
 }
@@ -0,0 +1,289 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+/*
+** Trivial recipe commands run without fork+exec of /bin/sh. A builtin
+** only handles the plain form of a command. On any error it undoes its
+** partial work or relies on the command being idempotent, and returns -1
+** so the real command runs through the shell. The shell then prints the
+** exact diagnostic and sets the exit status.
+*/
+
+/*Characters that give a command line a meaning only the shell knows*/
+#define SHELL_META "\"'\\$`|&;<>(){}[]*?~#=!\n"
+
+/*Size of the cp copy buffer*/
+#define COPY_BUF_SIZE 65536
+
+/*Print the arguments separated by spaces (echo without options)*/
+static int builtin_echo(char **argv, size_t argc)
+{
+    for (size_t i = 1; i < argc; i++)
+    {
+        /*-n, -e... differ between shells: let /bin/sh decide*/
+        if (argv[i][0] == '-')
+        {
+            return -1;
+        }
+    }
+    for (size_t i = 1; i < argc; i++)
+    {
+        if (i > 1)
+        {
+            putchar(' ');
+        }
+        fputs(argv[i], stdout);
+    }
+    putchar('\n');
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+/*Create a directory and its missing parents (mkdir -p)*/
+static int make_parents(char *path)
+{
+    for (char *p = path + 1; *p; p++)
+    {
+        if (*p != '/')
+        {
+            continue;
+        }
+        *p = '\0';
+        int ret = mkdir(path, 0777);
+        *p = '/';
+        if (ret != 0 && errno != EEXIST)
+        {
+            return -1;
+        }
+    }
+    struct stat st;
+    if (mkdir(path, 0777) != 0
+        && (errno != EEXIST || stat(path, &st) != 0 || !S_ISDIR(st.st_mode)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*mkdir [-p] DIR...*/
+static int builtin_mkdir(char **argv, size_t argc)
+{
+    int parents = argc > 1 && strcmp(argv[1], "-p") == 0;
+    size_t first = parents ? 2 : 1;
+    if (first >= argc)
+    {
+        return -1;
+    }
+    for (size_t i = first; i < argc; i++)
+    {
+        if (argv[i][0] == '-')
+        {
+            return -1;
+        }
+    }
+    for (size_t i = first; i < argc; i++)
+    {
+        if (parents ? make_parents(argv[i]) == 0 : mkdir(argv[i], 0777) == 0)
+        {
+            continue;
+        }
+        /*mkdir -p is idempotent, plain mkdir must be undone first*/
+        for (size_t j = first; !parents && j < i; j++)
+        {
+            rmdir(argv[j]);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/*rm -f FILE...*/
+static int builtin_rm(char **argv, size_t argc)
+{
+    if (argc < 3 || strcmp(argv[1], "-f") != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 2; i < argc; i++)
+    {
+        if (argv[i][0] == '-')
+        {
+            return -1;
+        }
+    }
+    for (size_t i = 2; i < argc; i++)
+    {
+        /*rm -f is idempotent: the shell can redo everything on error*/
+        if (unlink(argv[i]) != 0 && errno != ENOENT)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*touch FILE...*/
+static int builtin_touch(char **argv, size_t argc)
+{
+    if (argc < 2)
+    {
+        return -1;
+    }
+    for (size_t i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-')
+        {
+            return -1;
+        }
+    }
+    for (size_t i = 1; i < argc; i++)
+    {
+        int fd = open(argv[i], O_WRONLY | O_CREAT | O_NONBLOCK | O_NOCTTY,
+                      0666);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        int ret = futimens(fd, NULL);
+        close(fd);
+        if (ret != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*Copy the contents of one open file to another*/
+static int copy_fd(int in, int out)
+{
+    char buf[COPY_BUF_SIZE];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t w = write(out, buf + done, n - done);
+            if (w < 0)
+            {
+                return -1;
+            }
+            done += w;
+        }
+    }
+    return n == 0 ? 0 : -1;
+}
+
+/*cp SRC DST, for a regular SRC file*/
+static int builtin_cp(char **argv, size_t argc)
+{
+    if (argc != 3 || argv[1][0] == '-' || argv[2][0] == '-')
+    {
+        return -1;
+    }
+    struct stat src_st;
+    if (stat(argv[1], &src_st) != 0 || !S_ISREG(src_st.st_mode))
+    {
+        return -1;
+    }
+    /*cp SRC DIR copies to DIR/basename(SRC)*/
+    char *dst = string_duplicate(argv[2]);
+    struct stat dst_st;
+    int dst_exists = stat(dst, &dst_st) == 0;
+    if (dst_exists && S_ISDIR(dst_st.st_mode))
+    {
+        const char *base = strrchr(argv[1], '/');
+        base = base ? base + 1 : argv[1];
+        char *path = malloc(strlen(dst) + strlen(base) + 2);
+        if (!path)
+        {
+            error_exit("Memory allocation failed");
+        }
+        sprintf(path, "%s/%s", dst, base);
+        free(dst);
+        dst = path;
+        dst_exists = stat(dst, &dst_st) == 0;
+    }
+    /*Never truncate the source: "are the same file" is for cp to say*/
+    if (dst_exists
+        && (!S_ISREG(dst_st.st_mode)
+            || (dst_st.st_dev == src_st.st_dev
+                && dst_st.st_ino == src_st.st_ino)))
+    {
+        free(dst);
+        return -1;
+    }
+    int ret = -1;
+    int in = open(argv[1], O_RDONLY);
+    int out = -1;
+    if (in >= 0)
+    {
+        out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, src_st.st_mode & 0777);
+    }
+    if (out >= 0)
+    {
+        ret = copy_fd(in, out);
+        if (close(out) != 0)
+        {
+            ret = -1;
+        }
+    }
+    if (in >= 0)
+    {
+        close(in);
+    }
+    free(dst);
+    return ret;
+}
+
+/*Run cmd in-process if it is a trivial builtin: status, or -1 if not*/
+int builtin_run(const char *cmd)
+{
+    if (strpbrk(cmd, SHELL_META))
+    {
+        return -1;
+    }
+    size_t argc = 0;
+    char **argv = split_whitespace(cmd, &argc);
+    int ret = -1;
+    if (argc == 0)
+    {
+        ret = 0; /*Empty command: the shell does nothing and succeeds*/
+    }
+    else if (strcmp(argv[0], "echo") == 0)
+    {
+        ret = builtin_echo(argv, argc);
+    }
+    else if (strcmp(argv[0], "mkdir") == 0)
+    {
+        ret = builtin_mkdir(argv, argc);
+    }
+    else if (strcmp(argv[0], "rm") == 0)
+    {
+        ret = builtin_rm(argv, argc);
+    }
+    else if (strcmp(argv[0], "touch") == 0)
+    {
+        ret = builtin_touch(argv, argc);
+    }
+    else if (strcmp(argv[0], "cp") == 0)
+    {
+        ret = builtin_cp(argv, argc);
+    }
+    for (size_t i = 0; i < argc; i++)
+    {
+        free(argv[i]);
+    }
+    free(argv);
+    return ret;
+}
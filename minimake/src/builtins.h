@@ -0,0 +1,6 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+int builtin_run(const char *cmd);
+
+#endif /*BUILTINS_H*/
@@ -1,12 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "executor.h"
 
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "builtins.h"
+#include "jobserver.h"
+#include "stats.h"
+#include "supervisor.h"
 #include "utils.h"
 #include "variables.h"
 
@@ -142,73 +150,298 @@ static char *expand_special(const char *cmd, rule_t *rule)
     return result;
 }
 
-/* Execute a single command using /bin/sh -c */
-static int exec_command(const char *cmd)
+/* A recipe in progress: one shell command runs at a time */
+typedef struct job
+{
+    rule_t *rule; /* Rule whose recipe is running */
+    size_t line; /* Next recipe line to start */
+    pid_t pid; /* Running command */
+    int exited; /* The command exited, wstatus is set */
+    int wstatus;
+    int timed_out; /* Killed by the recipe timeout */
+    double deadline; /* End of the recipe timeout (0: none) */
+    int existed; /* The target existed when the recipe started */
+    struct timespec mtime; /* Its modification time then */
+} job_t;
+
+static job_t *jobs = NULL;
+static size_t job_count = 0;
+static size_t job_cap = 0;
+static double recipe_timeout = 0; /* --timeout: seconds per recipe */
+
+/* Limit the run time of each recipe (0: no limit) */
+void executor_set_timeout(double seconds)
+{
+    recipe_timeout = seconds;
+}
+
+/* Current monotonic time in seconds */
+static double monotonic_now(void)
 {
-    pid_t pid = fork();
-    if (pid < 0)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Record that a command exited (supervisor callback) */
+static void job_exited(pid_t pid, int wstatus, int timed_out, void *data)
+{
+    (void)data;
+    for (size_t i = 0; i < job_count; i++)
     {
-        error_msg("Fork failed");
-        return 2;
+        if (jobs[i].pid == pid)
+        {
+            jobs[i].exited = 1;
+            jobs[i].wstatus = wstatus;
+            jobs[i].timed_out = timed_out;
+            return;
+        }
     }
-    /* Child process: execute command */
-    if (pid == 0)
+}
+
+/* Start a single command using /bin/sh -c, return its pid */
+static pid_t spawn_command(const char *cmd, job_t *job)
+{
+    STATS_INC(forks);
+    STATS_INC(execs);
+    double timeout = 0;
+    if (job->deadline > 0)
     {
-        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
-        perror("execl");
-        exit(127);
+        timeout = job->deadline - monotonic_now();
+        timeout = timeout > 0 ? timeout : 1e-3;
     }
-    /* Parent process: wait for child */
-    int status;
-    waitpid(pid, &status, 0);
-    /* Check exit status */
-    if (WIFEXITED(status))
+    /* The environment is built (or taken from its cache) before forking */
+    return supervisor_launch(cmd, variable_environ(), timeout, job_exited,
+                             NULL);
+}
+
+/* Remember the target's state, to spot a partly written one later */
+static void job_snapshot(job_t *job)
+{
+    struct stat st;
+    STATS_INC(stat_calls);
+    job->existed = stat(job->rule->target, &st) == 0;
+    if (job->existed)
     {
-        int exit_code = WEXITSTATUS(status);
-        if (exit_code != 0)
-        {
-            return 2; /* Command failed */
-        }
+        job->mtime = st.st_mtim;
+    }
+}
+
+/* Delete a target the interrupted recipe had started to write */
+static void delete_partial(job_t *job)
+{
+    struct stat st;
+    if (job->rule->is_phony || stat(job->rule->target, &st) != 0)
+    {
+        return;
     }
-    else if (WIFSIGNALED(status))
+    if (job->existed && st.st_mtim.tv_sec == job->mtime.tv_sec
+        && st.st_mtim.tv_nsec == job->mtime.tv_nsec)
     {
-        return 2; /* Killed by signal */
+        return; /* Untouched */
     }
-    return 0;
+    char msg[512];
+    snprintf(msg, sizeof(msg), "*** Deleting file '%s'", job->rule->target);
+    error_msg(msg);
+    unlink(job->rule->target);
 }
 
-/* Execute all commands in a rule's recipe */
-int execute_recipe(rule_t *rule)
+/* Stop everything after Ctrl-C (or SIGTERM, SIGHUP) and die of it */
+static void handle_interrupt(void)
 {
-    for (size_t i = 0; i < rule->recipe_count; i++)
+    int sig = supervisor_interrupted();
+    supervisor_terminate(sig);
+    for (size_t i = 0; i < job_count; i++)
+    {
+        delete_partial(&jobs[i]);
+    }
+    jobserver_free();
+    supervisor_reraise(sig);
+}
+
+/* Convert a wait status to the recipe status (0 or 2) */
+static int command_status(int status)
+{
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        return 0;
+    }
+    return 2; /* Command failed or was killed by a signal */
+}
+
+/* Prepare and log a recipe line, return the command to run */
+static char *prepare_line(const char *line, rule_t *rule, int dry_run)
+{
+    /* Expand special variables ($@, $<, $^) */
+    char *special = expand_special(line, rule);
+    /* Expand regular variables */
+    char *expanded = variable_expand(special);
+    /* Remove leading whitespace */
+    char *cleaned = strip_leading_ws(expanded);
+    /* Remove @ sign */
+    char *exec_cmd = remove_at_sign(cleaned);
+    char *final_cmd = strip_leading_ws(exec_cmd);
+    /* Log command if not silent (a dry run shows every command) */
+    if (dry_run)
     {
-        /* Expand special variables ($@, $<, $^) */
-        char *special = expand_special(rule->recipe[i], rule);
-        /* Expand regular variables */
-        char *expanded = variable_expand(special);
-        /* Remove leading whitespace */
-        char *cleaned = strip_leading_ws(expanded);
-        /* Log command if not silent */
-        if (should_log(rule->recipe[i]))
+        printf("%s\n", final_cmd);
+    }
+    else if (should_log(line))
+    {
+        printf("%s\n", cleaned);
+    }
+    /* Cleanup */
+    free(special);
+    free(expanded);
+    free(cleaned);
+    free(exec_cmd);
+    return final_cmd;
+}
+
+/* Run recipe lines until one needs a shell: 0 running, 1 done, 2 error */
+static int job_advance(job_t *job)
+{
+    rule_t *rule = job->rule;
+    while (job->line < rule->recipe_count)
+    {
+        char *cmd = prepare_line(rule->recipe[job->line++], rule, 0);
+        /* Trivial commands run in-process, without fork+exec */
+        int ret = builtin_run(cmd);
+        if (ret < 0)
         {
-            printf("%s\n", cleaned);
-            fflush(stdout); /* Flush before execution */
+            fflush(stdout); /* Flush before forking */
+            job->exited = 0;
+            job->pid = spawn_command(cmd, job);
+            ret = job->pid < 0 ? 2 : 0;
+            free(cmd);
+            return ret;
         }
-        /* Remove @ sign and execute */
-        char *exec_cmd = remove_at_sign(cleaned);
-        char *final_cmd = strip_leading_ws(exec_cmd);
-        int ret = exec_command(final_cmd);
-        /* Cleanup */
-        free(special);
-        free(expanded);
-        free(cleaned);
-        free(exec_cmd);
-        free(final_cmd);
+        free(cmd);
+        STATS_INC(builtins);
         /* Stop on first error */
         if (ret != 0)
         {
-            return ret;
+            return 2;
         }
     }
-    return 0;
+    return 1; /* Recipe complete */
+}
+
+/* Drop a finished job from the table */
+static void job_remove(size_t index)
+{
+    jobs[index] = jobs[--job_count];
+}
+
+/* Start running a rule's recipe in the background */
+int executor_start(rule_t *rule)
+{
+    if (supervisor_interrupted())
+    {
+        handle_interrupt();
+    }
+    if (job_count >= job_cap)
+    {
+        job_cap = job_cap ? job_cap * 2 : 8;
+        jobs = realloc(jobs, sizeof(job_t) * job_cap);
+        if (!jobs)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    job_t *job = &jobs[job_count];
+    job->rule = rule;
+    job->line = 0;
+    job->pid = -1;
+    job->exited = 0;
+    job->timed_out = 0;
+    job->deadline = recipe_timeout > 0 ? monotonic_now() + recipe_timeout : 0;
+    job_snapshot(job);
+    int ret = job_advance(job);
+    if (ret == 0)
+    {
+        job_count++; /* First command is running */
+    }
+    return ret;
+}
+
+/* Number of recipes currently running */
+size_t executor_running(void)
+{
+    return job_count;
+}
+
+/* Wait for a running recipe to finish, return its rule and status */
+rule_t *executor_wait(int block, int *status)
+{
+    while (job_count > 0)
+    {
+        for (size_t i = 0; i < job_count; i++)
+        {
+            job_t *job = &jobs[i];
+            if (!job->exited)
+            {
+                continue;
+            }
+            job->exited = 0;
+            /* Stop on first error, otherwise run the next line */
+            int ret = command_status(job->wstatus);
+            if (job->timed_out)
+            {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "*** [%s] Timeout after %g s",
+                         job->rule->target, recipe_timeout);
+                error_msg(msg);
+                delete_partial(job);
+                ret = 2;
+            }
+            if (ret == 0)
+            {
+                ret = job_advance(job);
+            }
+            if (ret != 0)
+            {
+                rule_t *rule = job->rule;
+                job_remove(i);
+                *status = ret == 1 ? 0 : ret;
+                return rule;
+            }
+        }
+        /* Wait for the supervisor to report exits (or a timeout) */
+        int reaped = supervisor_poll(block ? -1 : 0);
+        if (reaped < 0)
+        {
+            handle_interrupt();
+        }
+        if (reaped == 0 && !block)
+        {
+            return NULL; /* Nothing finished yet */
+        }
+    }
+    return NULL;
+}
+
+/* Print the commands of a recipe without running them (-n) */
+void executor_print(rule_t *rule)
+{
+    for (size_t i = 0; i < rule->recipe_count; i++)
+    {
+        free(prepare_line(rule->recipe[i], rule, 1));
+    }
+}
+
+/* Execute all commands in a rule's recipe and wait for them */
+int execute_recipe(rule_t *rule)
+{
+    int ret = executor_start(rule);
+    if (ret != 0)
+    {
+        return ret == 1 ? 0 : ret;
+    }
+    int status = 0;
+    while (executor_wait(1, &status) != rule)
+    {
+        continue;
+    }
+    return status;
 }
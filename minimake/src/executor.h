@@ -3,6 +3,11 @@
 
 #include "rules.h"
 
+void executor_set_timeout(double seconds);
 int execute_recipe(rule_t *rule);
+void executor_print(rule_t *rule);
+int executor_start(rule_t *rule);
+size_t executor_running(void);
+rule_t *executor_wait(int block, int *status);
 
 #endif /*EXECUTOR_H*/
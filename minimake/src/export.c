@@ -0,0 +1,291 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "export.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "graph.h"
+#include "rules.h"
+#include "utils.h"
+#include "variables.h"
+
+/*Size of the output buffer: large graphs are written in big blocks*/
+#define OUT_BUFFER_SIZE 65536
+
+/*Magic and version at the start of the binary format*/
+#define BINARY_MAGIC "MMKG"
+#define BINARY_VERSION 2
+
+static char out_buf[OUT_BUFFER_SIZE];
+static size_t out_len = 0;
+static int out_error = 0;
+
+/*Write the buffered output to stdout*/
+static void out_flush(void)
+{
+    size_t done = 0;
+    while (done < out_len && !out_error)
+    {
+        ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (n < 0 && errno != EINTR)
+        {
+            out_error = 1;
+        }
+        done += n > 0 ? (size_t)n : 0;
+    }
+    out_len = 0;
+}
+
+/*Append bytes to the output buffer*/
+static void out_bytes(const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        if (out_len == OUT_BUFFER_SIZE)
+        {
+            out_flush();
+        }
+        size_t n = OUT_BUFFER_SIZE - out_len;
+        n = n < len ? n : len;
+        memcpy(out_buf + out_len, p, n);
+        out_len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/*Append a string*/
+static void out_str(const char *str)
+{
+    out_bytes(str, strlen(str));
+}
+
+/*Append an unsigned number in decimal*/
+static void out_num(size_t num)
+{
+    char tmp[32];
+    out_bytes(tmp, snprintf(tmp, sizeof(tmp), "%zu", num));
+}
+
+/*Append a string as a quoted JSON (or DOT) string*/
+static void out_quoted(const char *str)
+{
+    out_bytes("\"", 1);
+    for (; *str; str++)
+    {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+        {
+            char esc[2] = { '\\', c };
+            out_bytes(esc, 2);
+        }
+        else if (c < 0x20)
+        {
+            char esc[8];
+            out_bytes(esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+        }
+        else
+        {
+            out_bytes(str, 1);
+        }
+    }
+    out_bytes("\"", 1);
+}
+
+/*Append a 32-bit little-endian number*/
+static void out_u32(size_t num)
+{
+    unsigned char b[4] = { num & 0xff, (num >> 8) & 0xff, (num >> 16) & 0xff,
+                           (num >> 24) & 0xff };
+    out_bytes(b, 4);
+}
+
+/*Append a length-prefixed string*/
+static void out_blob(const char *str)
+{
+    size_t len = strlen(str);
+    out_u32(len);
+    out_bytes(str, len);
+}
+
+/*Stream the graph and variables as one JSON object*/
+static void export_json(variable_t **vars, size_t var_count)
+{
+    out_str("{\"variables\":[");
+    for (size_t i = 0; i < var_count; i++)
+    {
+        out_str(i ? ",\n{\"name\":" : "\n{\"name\":");
+        out_quoted(vars[i]->name);
+        out_str(vars[i]->flavor == VAR_SIMPLE ? ",\"flavor\":\"simple\""
+                                              : ",\"flavor\":\"recursive\"");
+        /*The value recipes see; a recursive one also keeps its text*/
+        out_str(",\"value\":");
+        out_quoted(variable_value(vars[i]->name));
+        if (vars[i]->flavor != VAR_SIMPLE)
+        {
+            out_str(",\"raw\":");
+            out_quoted(vars[i]->value);
+        }
+        out_str("}");
+    }
+    out_str("],\n\"targets\":[");
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        rule_t *rule = graph_rule(id);
+        out_str(id ? ",\n{\"id\":" : "\n{\"id\":");
+        out_num(id);
+        out_str(",\"name\":");
+        out_quoted(graph_name(id));
+        out_str(rule_is_phony(graph_name(id)) ? ",\"phony\":true"
+                                              : ",\"phony\":false");
+        out_str(rule ? ",\"rule\":true" : ",\"rule\":false");
+        out_str(",\"deps\":[");
+        size_t count;
+        const size_t *deps = graph_deps(id, &count);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i)
+            {
+                out_str(",");
+            }
+            out_num(deps[i]);
+        }
+        out_str("],\"recipe\":[");
+        for (size_t i = 0; rule && i < rule->recipe_count; i++)
+        {
+            if (i)
+            {
+                out_str(",");
+            }
+            /*Recipe lines are stored with their leading tab*/
+            out_quoted(rule->recipe[i] + (rule->recipe[i][0] == '\t'));
+        }
+        out_str("]}");
+    }
+    out_str("]}\n");
+}
+
+/*Stream the graph as a Graphviz digraph (variables as comments)*/
+static void export_dot(variable_t **vars, size_t var_count)
+{
+    out_str("digraph minimake {\n");
+    for (size_t i = 0; i < var_count; i++)
+    {
+        out_str("  // ");
+        out_str(vars[i]->name);
+        out_str(" := ");
+        out_str(variable_value(vars[i]->name));
+        out_str("\n");
+    }
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        out_str("  ");
+        out_quoted(graph_name(id));
+        if (rule_is_phony(graph_name(id)))
+        {
+            out_str(" [style=dashed]");
+        }
+        else if (!graph_rule(id))
+        {
+            out_str(" [shape=box]");
+        }
+        out_str(";\n");
+    }
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        size_t count;
+        const size_t *deps = graph_deps(id, &count);
+        for (size_t i = 0; i < count; i++)
+        {
+            out_str("  ");
+            out_quoted(graph_name(id));
+            out_str(" -> ");
+            out_quoted(graph_name(deps[i]));
+            out_str(";\n");
+        }
+    }
+    out_str("}\n");
+}
+
+/*
+ * Stream the graph as a binary edge list, all numbers 32-bit little-endian:
+ * "MMKG", version, node count, edge count, variable count; then per node a
+ * length-prefixed name and a flag byte (1 rule, 2 phony); then the edges as
+ * (target, dependency) ID pairs; then per variable a length-prefixed name,
+ * a flavor byte (0 recursive, 1 simple), the length-prefixed expanded value
+ * and the length-prefixed text as assigned.
+ */
+static void export_binary(variable_t **vars, size_t var_count)
+{
+    size_t edge_count = 0;
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        size_t count;
+        graph_deps(id, &count);
+        edge_count += count;
+    }
+    out_bytes(BINARY_MAGIC, 4);
+    out_u32(BINARY_VERSION);
+    out_u32(graph_size());
+    out_u32(edge_count);
+    out_u32(var_count);
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        unsigned char flags = (graph_rule(id) ? 1 : 0)
+            | (rule_is_phony(graph_name(id)) ? 2 : 0);
+        out_blob(graph_name(id));
+        out_bytes(&flags, 1);
+    }
+    for (size_t id = 0; id < graph_size(); id++)
+    {
+        size_t count;
+        const size_t *deps = graph_deps(id, &count);
+        for (size_t i = 0; i < count; i++)
+        {
+            out_u32(id);
+            out_u32(deps[i]);
+        }
+    }
+    for (size_t i = 0; i < var_count; i++)
+    {
+        unsigned char flavor = vars[i]->flavor == VAR_SIMPLE;
+        out_blob(vars[i]->name);
+        out_bytes(&flavor, 1);
+        out_blob(variable_value(vars[i]->name));
+        out_blob(vars[i]->value);
+    }
+}
+
+/*Export the resolved graph and the variables to stdout*/
+int export_graph(int format)
+{
+    size_t var_count;
+    variable_t **vars = variables_all(&var_count);
+    graph_build();
+    fflush(stdout);
+    if (format == EXPORT_JSON)
+    {
+        export_json(vars, var_count);
+    }
+    else if (format == EXPORT_DOT)
+    {
+        export_dot(vars, var_count);
+    }
+    else
+    {
+        export_binary(vars, var_count);
+    }
+    out_flush();
+    free(vars);
+    if (out_error)
+    {
+        error_msg("write error: stdout");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+/*Graph export formats (--export=FORMAT)*/
+enum export_format
+{
+    EXPORT_TEXT = 0, /*-p: quoted text*/
+    EXPORT_JSON,
+    EXPORT_DOT,
+    EXPORT_BINARY
+};
+
+int export_graph(int format);
+
+#endif /*EXPORT_H*/
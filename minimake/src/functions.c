@@ -0,0 +1,786 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "functions.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "utils.h"
+#include "variables.h"
+
+/*Number of buckets of the per-run caches*/
+#define CACHE_BUCKETS 256
+
+/*Growable output string*/
+typedef struct buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+/*Listing of one directory, read once per run*/
+typedef struct dir_cache {
+    char *path;
+    char **entries; /*NULL if the directory cannot be opened*/
+    size_t count;
+    struct dir_cache *next;
+} dir_cache_t;
+
+/*Output of one $(shell ...) command, run once per run*/
+typedef struct shell_cache {
+    char *command;
+    char *output;
+    struct shell_cache *next;
+} shell_cache_t;
+
+static dir_cache_t *dir_buckets[CACHE_BUCKETS];
+static shell_cache_t *shell_buckets[CACHE_BUCKETS];
+
+/*Hash a cache key (djb2)*/
+static size_t cache_hash(const char *str)
+{
+    size_t h = 5381;
+    for (; *str; str++)
+    {
+        h = h * 33 + (unsigned char)*str;
+    }
+    return h % CACHE_BUCKETS;
+}
+
+/*Append len bytes to a buffer*/
+static void buffer_append(buffer_t *buf, const char *str, size_t len)
+{
+    if (buf->len + len + 1 > buf->cap)
+    {
+        buf->cap = buf->cap ? buf->cap : 64;
+        while (buf->len + len + 1 > buf->cap)
+        {
+            buf->cap *= 2;
+        }
+        buf->data = realloc(buf->data, buf->cap);
+        if (!buf->data)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+/*Append a word, separated from the previous one by a space*/
+static void buffer_add_word(buffer_t *buf, const char *word, size_t len)
+{
+    if (buf->len > 0)
+    {
+        buffer_append(buf, " ", 1);
+    }
+    buffer_append(buf, word, len);
+}
+
+/*Return the buffer contents (never NULL)*/
+static char *buffer_finish(buffer_t *buf)
+{
+    if (!buf->data)
+    {
+        return string_duplicate("");
+    }
+    return buf->data;
+}
+
+/*Free an array returned by split_whitespace*/
+static void free_words(char **words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(words[i]);
+    }
+    free(words);
+}
+
+/*Match word against a pattern with at most one %, set the stem*/
+static int pattern_match(const char *pattern, const char *word,
+                         const char **stem, size_t *stem_len)
+{
+    const char *percent = strchr(pattern, '%');
+    if (!percent)
+    {
+        return strcmp(pattern, word) == 0;
+    }
+    size_t prefix = percent - pattern;
+    size_t suffix = strlen(percent + 1);
+    size_t len = strlen(word);
+    if (len < prefix + suffix || strncmp(pattern, word, prefix) != 0
+        || strcmp(word + len - suffix, percent + 1) != 0)
+    {
+        return 0;
+    }
+    *stem = word + prefix;
+    *stem_len = len - prefix - suffix;
+    return 1;
+}
+
+/*Replace words matching pattern by replacement (% is the stem)*/
+char *patsubst_words(const char *pattern, const char *replacement,
+                     const char *text)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **words = split_whitespace(text, &count);
+    const char *rep_percent = strchr(replacement, '%');
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *stem = NULL;
+        size_t stem_len = 0;
+        if (!pattern_match(pattern, words[i], &stem, &stem_len))
+        {
+            buffer_add_word(&buf, words[i], strlen(words[i]));
+        }
+        else if (!rep_percent || !stem)
+        {
+            buffer_add_word(&buf, replacement, strlen(replacement));
+        }
+        else
+        {
+            buffer_add_word(&buf, replacement, rep_percent - replacement);
+            buffer_append(&buf, stem, stem_len);
+            buffer_append(&buf, rep_percent + 1, strlen(rep_percent + 1));
+        }
+    }
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*$(subst from,to,text)*/
+static char *fn_subst(char **args)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t from_len = strlen(args[0]);
+    const char *text = args[2];
+    if (from_len == 0)
+    {
+        return string_duplicate(text);
+    }
+    for (const char *hit; (hit = strstr(text, args[0])); text = hit + from_len)
+    {
+        buffer_append(&buf, text, hit - text);
+        buffer_append(&buf, args[1], strlen(args[1]));
+    }
+    buffer_append(&buf, text, strlen(text));
+    return buffer_finish(&buf);
+}
+
+/*$(patsubst pattern,replacement,text)*/
+static char *fn_patsubst(char **args)
+{
+    return patsubst_words(trim_whitespace(args[0]), trim_whitespace(args[1]),
+                          args[2]);
+}
+
+/*$(strip text)*/
+static char *fn_strip(char **args)
+{
+    return patsubst_words("%", "%", args[0]);
+}
+
+/*$(findstring find,in)*/
+static char *fn_findstring(char **args)
+{
+    return string_duplicate(strstr(args[1], args[0]) ? args[0] : "");
+}
+
+/*Keep (or drop) the words matching one of the patterns*/
+static char *filter_words(const char *patterns, const char *text, int keep)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t pat_count = 0;
+    size_t count = 0;
+    char **pats = split_whitespace(patterns, &pat_count);
+    char **words = split_whitespace(text, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        int matched = 0;
+        for (size_t j = 0; j < pat_count && !matched; j++)
+        {
+            const char *stem;
+            size_t stem_len;
+            matched = pattern_match(pats[j], words[i], &stem, &stem_len);
+        }
+        if (matched == keep)
+        {
+            buffer_add_word(&buf, words[i], strlen(words[i]));
+        }
+    }
+    free_words(pats, pat_count);
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*$(filter patterns,text)*/
+static char *fn_filter(char **args)
+{
+    return filter_words(args[0], args[1], 1);
+}
+
+/*$(filter-out patterns,text)*/
+static char *fn_filter_out(char **args)
+{
+    return filter_words(args[0], args[1], 0);
+}
+
+/*qsort comparator for words*/
+static int compare_words(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*$(sort list): sorted, without duplicates*/
+static char *fn_sort(char **args)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **words = split_whitespace(args[0], &count);
+    qsort(words, count, sizeof(char *), compare_words);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i == 0 || strcmp(words[i], words[i - 1]) != 0)
+        {
+            buffer_add_word(&buf, words[i], strlen(words[i]));
+        }
+    }
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*Words start..end (1-based, inclusive) of text*/
+static char *word_range(size_t start, size_t end, const char *text)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **words = split_whitespace(text, &count);
+    for (size_t i = start; i <= end && i <= count; i++)
+    {
+        if (i > 0)
+        {
+            buffer_add_word(&buf, words[i - 1], strlen(words[i - 1]));
+        }
+    }
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*$(word n,text)*/
+static char *fn_word(char **args)
+{
+    long n = atol(args[0]);
+    if (n <= 0)
+    {
+        error_exit("first argument to 'word' function must be greater than 0");
+    }
+    return word_range(n, n, args[1]);
+}
+
+/*$(wordlist start,end,text)*/
+static char *fn_wordlist(char **args)
+{
+    long start = atol(args[0]);
+    long end = atol(args[1]);
+    if (start <= 0)
+    {
+        error_exit("invalid first argument to 'wordlist' function");
+    }
+    return end < start ? string_duplicate("") : word_range(start, end, args[2]);
+}
+
+/*$(words text)*/
+static char *fn_words(char **args)
+{
+    size_t count = 0;
+    char **words = split_whitespace(args[0], &count);
+    free_words(words, count);
+    char num[32];
+    snprintf(num, sizeof(num), "%zu", count);
+    return string_duplicate(num);
+}
+
+/*$(firstword text)*/
+static char *fn_firstword(char **args)
+{
+    return word_range(1, 1, args[0]);
+}
+
+/*$(lastword text)*/
+static char *fn_lastword(char **args)
+{
+    size_t count = 0;
+    char **words = split_whitespace(args[0], &count);
+    free_words(words, count);
+    return word_range(count, count, args[0]);
+}
+
+/*Apply a per-word transformation to a list of file names*/
+static char *map_names(const char *text, const char *(*part)(const char *,
+                                                            size_t *))
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **words = split_whitespace(text, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t len = 0;
+        const char *res = part(words[i], &len);
+        if (res)
+        {
+            buffer_add_word(&buf, res, len);
+        }
+    }
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*Directory part of a name, with its trailing slash*/
+static const char *dir_part(const char *name, size_t *len)
+{
+    const char *slash = strrchr(name, '/');
+    if (!slash)
+    {
+        *len = 2;
+        return "./";
+    }
+    *len = slash - name + 1;
+    return name;
+}
+
+/*Name without its directory part*/
+static const char *notdir_part(const char *name, size_t *len)
+{
+    const char *slash = strrchr(name, '/');
+    const char *base = slash ? slash + 1 : name;
+    *len = strlen(base);
+    return base;
+}
+
+/*Suffix of a name (last dot of the file part), NULL if none*/
+static const char *suffix_part(const char *name, size_t *len)
+{
+    const char *slash = strrchr(name, '/');
+    const char *dot = strrchr(name, '.');
+    if (!dot || (slash && dot < slash))
+    {
+        return NULL;
+    }
+    *len = strlen(dot);
+    return dot;
+}
+
+/*Name without its suffix*/
+static const char *basename_part(const char *name, size_t *len)
+{
+    size_t suffix_len = 0;
+    const char *suffix = suffix_part(name, &suffix_len);
+    *len = suffix ? (size_t)(suffix - name) : strlen(name);
+    return name;
+}
+
+/*$(dir names)*/
+static char *fn_dir(char **args)
+{
+    return map_names(args[0], dir_part);
+}
+
+/*$(notdir names)*/
+static char *fn_notdir(char **args)
+{
+    return map_names(args[0], notdir_part);
+}
+
+/*$(suffix names)*/
+static char *fn_suffix(char **args)
+{
+    return map_names(args[0], suffix_part);
+}
+
+/*$(basename names)*/
+static char *fn_basename(char **args)
+{
+    return map_names(args[0], basename_part);
+}
+
+/*Add a prefix and a suffix to every word*/
+static char *wrap_words(const char *prefix, const char *suffix,
+                        const char *text)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **words = split_whitespace(text, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        buffer_add_word(&buf, prefix, strlen(prefix));
+        buffer_append(&buf, words[i], strlen(words[i]));
+        buffer_append(&buf, suffix, strlen(suffix));
+    }
+    free_words(words, count);
+    return buffer_finish(&buf);
+}
+
+/*$(addprefix prefix,names)*/
+static char *fn_addprefix(char **args)
+{
+    return wrap_words(args[0], "", args[1]);
+}
+
+/*$(addsuffix suffix,names)*/
+static char *fn_addsuffix(char **args)
+{
+    return wrap_words("", args[0], args[1]);
+}
+
+/*$(join list1,list2)*/
+static char *fn_join(char **args)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count1 = 0;
+    size_t count2 = 0;
+    char **words1 = split_whitespace(args[0], &count1);
+    char **words2 = split_whitespace(args[1], &count2);
+    for (size_t i = 0; i < count1 || i < count2; i++)
+    {
+        const char *w1 = i < count1 ? words1[i] : "";
+        const char *w2 = i < count2 ? words2[i] : "";
+        buffer_add_word(&buf, w1, strlen(w1));
+        buffer_append(&buf, w2, strlen(w2));
+    }
+    free_words(words1, count1);
+    free_words(words2, count2);
+    return buffer_finish(&buf);
+}
+
+/*Get the listing of a directory, reading it only once per run*/
+static dir_cache_t *dir_listing(const char *path)
+{
+    size_t h = cache_hash(path);
+    for (dir_cache_t *d = dir_buckets[h]; d; d = d->next)
+    {
+        if (strcmp(d->path, path) == 0)
+        {
+            return d;
+        }
+    }
+    dir_cache_t *d = calloc(1, sizeof(dir_cache_t));
+    if (!d)
+    {
+        error_exit("Memory allocation failed");
+    }
+    d->path = string_duplicate(path);
+    STATS_INC(dir_scans);
+    DIR *dir = opendir(*path ? path : ".");
+    if (dir)
+    {
+        size_t cap = 16;
+        d->entries = malloc(sizeof(char *) * cap);
+        if (!d->entries)
+        {
+            error_exit("Memory allocation failed");
+        }
+        for (struct dirent *e; (e = readdir(dir));)
+        {
+            if (d->count >= cap)
+            {
+                cap *= 2;
+                d->entries = realloc(d->entries, sizeof(char *) * cap);
+                if (!d->entries)
+                {
+                    error_exit("Memory allocation failed");
+                }
+            }
+            d->entries[d->count++] = string_duplicate(e->d_name);
+        }
+        closedir(dir);
+    }
+    d->next = dir_buckets[h];
+    dir_buckets[h] = d;
+    return d;
+}
+
+/*Expand the glob components of pattern that follow the prefix*/
+static void glob_expand(const char *prefix, const char *pattern,
+                        char ***out, size_t *count, size_t *cap)
+{
+    /*Split off the next path component*/
+    const char *slash = strchr(pattern, '/');
+    size_t comp_len = slash ? (size_t)(slash - pattern) : strlen(pattern);
+    char *comp = strndup(pattern, comp_len);
+    const char *rest = slash ? slash + 1 : NULL;
+    /*Candidate names for this component*/
+    dir_cache_t *dir = NULL;
+    if (strpbrk(comp, "*?["))
+    {
+        dir = dir_listing(prefix);
+    }
+    size_t n = dir ? dir->count : 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *name = dir ? dir->entries[i] : comp;
+        if (dir && fnmatch(comp, name, FNM_PERIOD) != 0)
+        {
+            continue;
+        }
+        char *path = malloc(strlen(prefix) + strlen(name) + 2);
+        if (!path)
+        {
+            error_exit("Memory allocation failed");
+        }
+        sprintf(path, "%s%s", prefix, name);
+        if (rest && *rest)
+        {
+            strcat(path, "/");
+            glob_expand(path, rest, out, count, cap);
+            free(path);
+            continue;
+        }
+        if (rest)
+        {
+            strcat(path, "/"); /*Trailing slash: keep it*/
+        }
+        /*Listed names exist; literal names and dir/ need a check*/
+        if ((!dir || rest) && !file_exists(path))
+        {
+            free(path);
+            continue;
+        }
+        if (*count >= *cap)
+        {
+            *cap = *cap ? *cap * 2 : 16;
+            *out = realloc(*out, sizeof(char *) * *cap);
+            if (!*out)
+            {
+                error_exit("Memory allocation failed");
+            }
+        }
+        (*out)[(*count)++] = path;
+    }
+    free(comp);
+}
+
+/*$(wildcard patterns)*/
+static char *fn_wildcard(char **args)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    size_t count = 0;
+    char **patterns = split_whitespace(args[0], &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        char **matches = NULL;
+        size_t match_count = 0;
+        size_t match_cap = 0;
+        const char *pattern = patterns[i];
+        glob_expand(pattern[0] == '/' ? "/" : "",
+                    pattern[0] == '/' ? pattern + 1 : pattern, &matches,
+                    &match_count, &match_cap);
+        qsort(matches, match_count, sizeof(char *), compare_words);
+        for (size_t j = 0; j < match_count; j++)
+        {
+            buffer_add_word(&buf, matches[j], strlen(matches[j]));
+        }
+        free_words(matches, match_count);
+    }
+    free_words(patterns, count);
+    return buffer_finish(&buf);
+}
+
+/*Run a command and capture its output, newlines turned into spaces*/
+static char *run_shell(const char *command)
+{
+    buffer_t buf = { NULL, 0, 0 };
+    fflush(stdout); /*Flush before forking*/
+    STATS_INC(forks);
+    STATS_INC(execs);
+    FILE *p = popen(command, "r");
+    if (!p)
+    {
+        return string_duplicate("");
+    }
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), p)) > 0)
+    {
+        buffer_append(&buf, chunk, n);
+    }
+    pclose(p);
+    char *out = buffer_finish(&buf);
+    size_t len = strlen(out);
+    while (len > 0 && out[len - 1] == '\n')
+    {
+        out[--len] = '\0';
+    }
+    for (char *c = out; *c; c++)
+    {
+        if (*c == '\n')
+        {
+            *c = ' ';
+        }
+    }
+    return out;
+}
+
+/*$(shell command), memoized for the whole run*/
+static char *fn_shell(char **args)
+{
+    size_t h = cache_hash(args[0]);
+    for (shell_cache_t *s = shell_buckets[h]; s; s = s->next)
+    {
+        if (strcmp(s->command, args[0]) == 0)
+        {
+            return string_duplicate(s->output);
+        }
+    }
+    shell_cache_t *s = malloc(sizeof(shell_cache_t));
+    if (!s)
+    {
+        error_exit("Memory allocation failed");
+    }
+    s->command = string_duplicate(args[0]);
+    s->output = run_shell(args[0]);
+    s->next = shell_buckets[h];
+    shell_buckets[h] = s;
+    return string_duplicate(s->output);
+}
+
+/*Built-in functions: the last argument takes any extra commas*/
+static const struct function {
+    const char *name;
+    size_t args;
+    char *(*call)(char **args);
+} functions[] = {
+    { "subst", 3, fn_subst },
+    { "patsubst", 3, fn_patsubst },
+    { "strip", 1, fn_strip },
+    { "findstring", 2, fn_findstring },
+    { "filter", 2, fn_filter },
+    { "filter-out", 2, fn_filter_out },
+    { "sort", 1, fn_sort },
+    { "word", 2, fn_word },
+    { "wordlist", 3, fn_wordlist },
+    { "words", 1, fn_words },
+    { "firstword", 1, fn_firstword },
+    { "lastword", 1, fn_lastword },
+    { "dir", 1, fn_dir },
+    { "notdir", 1, fn_notdir },
+    { "suffix", 1, fn_suffix },
+    { "basename", 1, fn_basename },
+    { "addprefix", 2, fn_addprefix },
+    { "addsuffix", 2, fn_addsuffix },
+    { "join", 2, fn_join },
+    { "wildcard", 1, fn_wildcard },
+    { "shell", 1, fn_shell },
+};
+
+/*Maximum number of arguments of a built-in function*/
+#define MAX_FUNCTION_ARGS 3
+
+/*Split raw arguments at top-level commas (not inside $(...))*/
+static size_t split_args(const char *raw, size_t max, char **args)
+{
+    size_t count = 0;
+    int depth = 0;
+    const char *start = raw;
+    for (const char *p = raw; *p; p++)
+    {
+        if (*p == '(' || *p == '{')
+        {
+            depth++;
+        }
+        else if ((*p == ')' || *p == '}') && depth > 0)
+        {
+            depth--;
+        }
+        else if (*p == ',' && depth == 0 && count + 1 < max)
+        {
+            args[count++] = strndup(start, p - start);
+            start = p + 1;
+        }
+    }
+    args[count++] = string_duplicate(start);
+    return count;
+}
+
+/*Evaluate text as a function call, NULL if it is not one*/
+char *function_expand(const char *text)
+{
+    size_t name_len = strcspn(text, " \t");
+    if (text[name_len] == '\0')
+    {
+        return NULL; /*A function name is followed by blanks*/
+    }
+    const struct function *fn = NULL;
+    for (size_t i = 0; i < sizeof(functions) / sizeof(*functions); i++)
+    {
+        if (strlen(functions[i].name) == name_len
+            && strncmp(functions[i].name, text, name_len) == 0)
+        {
+            fn = &functions[i];
+            break;
+        }
+    }
+    if (!fn)
+    {
+        return NULL;
+    }
+    const char *raw = text + name_len;
+    while (isblank((unsigned char)*raw))
+    {
+        raw++;
+    }
+    char *args[MAX_FUNCTION_ARGS];
+    size_t count = split_args(raw, fn->args, args);
+    if (count < fn->args)
+    {
+        char msg[256];
+        snprintf(msg, sizeof(msg),
+                 "insufficient number of arguments (%zu) to function '%s'",
+                 count, fn->name);
+        error_exit(msg);
+    }
+    /*Arguments are expanded before the function runs*/
+    for (size_t i = 0; i < count; i++)
+    {
+        char *expanded = variable_expand(args[i]);
+        free(args[i]);
+        args[i] = expanded;
+    }
+    char *result = fn->call(args);
+    for (size_t i = 0; i < count; i++)
+    {
+        free(args[i]);
+    }
+    return result;
+}
+
+/*Free the directory and $(shell) caches*/
+void functions_free(void)
+{
+    for (size_t i = 0; i < CACHE_BUCKETS; i++)
+    {
+        while (dir_buckets[i])
+        {
+            dir_cache_t *d = dir_buckets[i];
+            dir_buckets[i] = d->next;
+            free_words(d->entries, d->count);
+            free(d->path);
+            free(d);
+        }
+        while (shell_buckets[i])
+        {
+            shell_cache_t *s = shell_buckets[i];
+            shell_buckets[i] = s->next;
+            free(s->command);
+            free(s->output);
+            free(s);
+        }
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef FUNCTIONS_H
+#define FUNCTIONS_H
+
+char *function_expand(const char *text);
+char *patsubst_words(const char *pattern, const char *replacement,
+                     const char *text);
+void functions_free(void);
+
+#endif /*FUNCTIONS_H*/
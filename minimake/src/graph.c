@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "graph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "utils.h"
+#include "variables.h"
+
+/*Nodes, indexed by ID*/
+static const char **names = NULL; /*Interned target names*/
+static rule_t **node_rules = NULL; /*Rule building each ID, or NULL*/
+static size_t node_count = 0;
+static size_t node_cap = 0;
+
+/*Node ID of each interned string, indexed by string ID*/
+static size_t *node_of = NULL;
+static size_t node_of_cap = 0;
+
+/*Forward and reverse edges in compressed sparse row form*/
+static size_t *dep_start = NULL;
+static size_t *dep_ids = NULL;
+static size_t *rdep_start = NULL;
+static size_t *rdep_ids = NULL;
+static size_t built_count = 0; /*Nodes covered by the edge arrays*/
+static int dirty = 1; /*Rules changed since the last build*/
+
+/*Allocate a zeroed array or stop*/
+static void *array_alloc(size_t count, size_t size)
+{
+    void *p = calloc(count ? count : 1, size);
+    if (!p)
+    {
+        error_exit("Memory allocation failed");
+    }
+    return p;
+}
+
+/*Cover every interned string in the node map*/
+static void grow_node_of(void)
+{
+    size_t needed = intern_count();
+    if (needed <= node_of_cap)
+    {
+        return;
+    }
+    size_t cap = node_of_cap ? node_of_cap : 256;
+    while (cap < needed)
+    {
+        cap *= 2;
+    }
+    node_of = realloc(node_of, sizeof(size_t) * cap);
+    if (!node_of)
+    {
+        error_exit("Memory allocation failed");
+    }
+    /*All GRAPH_NONE*/
+    memset(node_of + node_of_cap, 0xff, sizeof(size_t) * (cap - node_of_cap));
+    node_of_cap = cap;
+}
+
+/*Reset the graph*/
+void graph_init(void)
+{
+    names = NULL;
+    node_rules = NULL;
+    node_count = 0;
+    node_cap = 0;
+    node_of = NULL;
+    node_of_cap = 0;
+    dep_start = NULL;
+    dep_ids = NULL;
+    rdep_start = NULL;
+    rdep_ids = NULL;
+    built_count = 0;
+    dirty = 1;
+}
+
+/*Get the ID of a target name, creating it on first use*/
+size_t graph_intern(const char *name)
+{
+    size_t sym = intern(name);
+    grow_node_of();
+    if (node_of[sym] != GRAPH_NONE)
+    {
+        return node_of[sym];
+    }
+    if (node_count >= node_cap)
+    {
+        node_cap = node_cap ? node_cap * 2 : 64;
+        names = realloc(names, sizeof(char *) * node_cap);
+        node_rules = realloc(node_rules, sizeof(rule_t *) * node_cap);
+        if (!names || !node_rules)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    names[node_count] = intern_name(sym);
+    node_rules[node_count] = NULL;
+    node_of[sym] = node_count;
+    dirty = 1;
+    return node_count++;
+}
+
+/*Get the ID of a known target name, or GRAPH_NONE*/
+size_t graph_lookup(const char *name)
+{
+    size_t sym = intern_find(name);
+    return sym < node_of_cap ? node_of[sym] : GRAPH_NONE;
+}
+
+/*Number of interned targets*/
+size_t graph_size(void)
+{
+    return node_count;
+}
+
+/*Name of a target ID*/
+const char *graph_name(size_t id)
+{
+    return names[id];
+}
+
+/*Attach the rule building a target (a later definition wins)*/
+void graph_set_rule(size_t id, rule_t *rule)
+{
+    node_rules[id] = rule;
+    dirty = 1;
+}
+
+/*Rule building a target ID, NULL for a plain file*/
+rule_t *graph_rule(size_t id)
+{
+    return node_rules[id];
+}
+
+/*Free the edge arrays*/
+static void free_edges(void)
+{
+    free(dep_start);
+    free(dep_ids);
+    free(rdep_start);
+    free(rdep_ids);
+    dep_start = NULL;
+    dep_ids = NULL;
+    rdep_start = NULL;
+    rdep_ids = NULL;
+    built_count = 0;
+}
+
+/*Intern the expanded dependencies of every rule and lay out the edges*/
+void graph_build(void)
+{
+    if (!dirty)
+    {
+        return;
+    }
+    free_edges();
+    /*Count edges first: interning may add file-only nodes at the end*/
+    size_t edge_count = 0;
+    for (size_t id = 0; id < node_count; id++)
+    {
+        edge_count += node_rules[id] ? node_rules[id]->dep_count : 0;
+    }
+    size_t *targets = array_alloc(edge_count, sizeof(size_t));
+    size_t pos = 0;
+    for (size_t id = 0; id < node_count; id++)
+    {
+        rule_t *rule = node_rules[id];
+        for (size_t i = 0; rule && i < rule->dep_count; i++)
+        {
+            char *dep = variable_expand(rule->dependencies[i]);
+            targets[pos++] = graph_intern(dep);
+            free(dep);
+        }
+    }
+    built_count = node_count;
+    dep_start = array_alloc(built_count + 1, sizeof(size_t));
+    rdep_start = array_alloc(built_count + 1, sizeof(size_t));
+    dep_ids = targets;
+    rdep_ids = array_alloc(edge_count, sizeof(size_t));
+    /*Forward rows follow the node order used above*/
+    for (size_t id = 0; id < built_count; id++)
+    {
+        size_t deps = node_rules[id] ? node_rules[id]->dep_count : 0;
+        dep_start[id + 1] = dep_start[id] + deps;
+        for (size_t e = dep_start[id]; e < dep_start[id + 1]; e++)
+        {
+            rdep_start[dep_ids[e] + 1]++;
+        }
+    }
+    /*Reverse rows: prefix sums of in-degrees, then a counting-sort fill*/
+    for (size_t id = 0; id < built_count; id++)
+    {
+        rdep_start[id + 1] += rdep_start[id];
+    }
+    size_t *fill = array_alloc(built_count, sizeof(size_t));
+    memcpy(fill, rdep_start, sizeof(size_t) * built_count);
+    for (size_t id = 0; id < built_count; id++)
+    {
+        for (size_t e = dep_start[id]; e < dep_start[id + 1]; e++)
+        {
+            rdep_ids[fill[dep_ids[e]]++] = id;
+        }
+    }
+    free(fill);
+    dirty = 0;
+}
+
+/*Dependencies of a target ID, in declaration order*/
+const size_t *graph_deps(size_t id, size_t *count)
+{
+    graph_build();
+    *count = id < built_count ? dep_start[id + 1] - dep_start[id] : 0;
+    return *count ? dep_ids + dep_start[id] : NULL;
+}
+
+/*IDs whose rules depend on a target ID*/
+const size_t *graph_dependents(size_t id, size_t *count)
+{
+    graph_build();
+    *count = id < built_count ? rdep_start[id + 1] - rdep_start[id] : 0;
+    return *count ? rdep_ids + rdep_start[id] : NULL;
+}
+
+/*Free the graph (rules and names are owned elsewhere)*/
+void graph_free(void)
+{
+    free(names);
+    free(node_rules);
+    free(node_of);
+    free_edges();
+    graph_init();
+}
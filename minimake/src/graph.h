@@ -0,0 +1,29 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stddef.h>
+
+#include "rules.h"
+
+/*Identifier of no target*/
+#define GRAPH_NONE ((size_t)-1)
+
+/*
+ * Dependency graph: every target name is interned to a dense ID, and the
+ * edges are stored in compressed sparse row form. The dependencies of ID i
+ * are dep_ids[dep_start[i] .. dep_start[i + 1]], and the reverse index
+ * lists the IDs whose rules depend on i in the same layout.
+ */
+void graph_init(void);
+size_t graph_intern(const char *name);
+size_t graph_lookup(const char *name);
+size_t graph_size(void);
+const char *graph_name(size_t id);
+void graph_set_rule(size_t id, rule_t *rule);
+rule_t *graph_rule(size_t id);
+void graph_build(void);
+const size_t *graph_deps(size_t id, size_t *count);
+const size_t *graph_dependents(size_t id, size_t *count);
+void graph_free(void);
+
+#endif /*GRAPH_H*/
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/*Strings are packed into chunks of this many bytes (longer ones alone)*/
+#define CHUNK_SIZE 65536
+
+/*Block of string storage*/
+typedef struct chunk {
+    struct chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} chunk_t;
+
+static chunk_t *chunks = NULL;
+
+/*Interned strings and their hashes, indexed by ID*/
+static const char **strings = NULL;
+static size_t *hashes = NULL;
+static size_t string_count = 0;
+static size_t string_cap = 0;
+
+/*Hash to ID table (open addressing, power of two capacity)*/
+static size_t *slots = NULL;
+static size_t slot_cap = 0;
+
+/*Hash a string (djb2)*/
+static size_t string_hash(const char *str)
+{
+    size_t h = 5381;
+    for (; *str; str++)
+    {
+        h = h * 33 + (unsigned char)*str;
+    }
+    return h;
+}
+
+/*Find the slot of a string: its ID slot, or the empty slot to fill*/
+static size_t *find_slot(const char *str, size_t hash)
+{
+    size_t mask = slot_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        size_t id = slots[i];
+        if (id == INTERN_NONE
+            || (hashes[id] == hash && strcmp(strings[id], str) == 0))
+        {
+            return &slots[i];
+        }
+    }
+}
+
+/*Double the table and re-insert every ID*/
+static void grow_slots(void)
+{
+    free(slots);
+    slot_cap = slot_cap ? slot_cap * 2 : 256;
+    slots = malloc(sizeof(size_t) * slot_cap);
+    if (!slots)
+    {
+        error_exit("Memory allocation failed");
+    }
+    memset(slots, 0xff, sizeof(size_t) * slot_cap); /*All INTERN_NONE*/
+    for (size_t id = 0; id < string_count; id++)
+    {
+        *find_slot(strings[id], hashes[id]) = id;
+    }
+}
+
+/*Copy a string into chunk storage*/
+static const char *store(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    if (!chunks || chunks->used + len > chunks->size)
+    {
+        size_t size = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+        chunk_t *c = malloc(sizeof(chunk_t) + size);
+        if (!c)
+        {
+            error_exit("Memory allocation failed");
+        }
+        c->used = 0;
+        c->size = size;
+        c->next = chunks;
+        chunks = c;
+    }
+    char *copy = chunks->data + chunks->used;
+    memcpy(copy, str, len);
+    chunks->used += len;
+    return copy;
+}
+
+/*Get the ID of a string, storing it on first use*/
+size_t intern(const char *str)
+{
+    if ((string_count + 1) * 2 > slot_cap)
+    {
+        grow_slots();
+    }
+    size_t hash = string_hash(str);
+    size_t *slot = find_slot(str, hash);
+    if (*slot != INTERN_NONE)
+    {
+        return *slot;
+    }
+    if (string_count >= string_cap)
+    {
+        string_cap = string_cap ? string_cap * 2 : 256;
+        strings = realloc(strings, sizeof(char *) * string_cap);
+        hashes = realloc(hashes, sizeof(size_t) * string_cap);
+        if (!strings || !hashes)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    strings[string_count] = store(str);
+    hashes[string_count] = hash;
+    *slot = string_count;
+    return string_count++;
+}
+
+/*Get the ID of an already interned string, or INTERN_NONE*/
+size_t intern_find(const char *str)
+{
+    if (slot_cap == 0)
+    {
+        return INTERN_NONE;
+    }
+    return *find_slot(str, string_hash(str));
+}
+
+/*Get the string of an ID*/
+const char *intern_name(size_t id)
+{
+    return strings[id];
+}
+
+/*Get the shared copy of a string*/
+const char *intern_str(const char *str)
+{
+    size_t id = intern(str); /*May move the strings array*/
+    return strings[id];
+}
+
+/*Number of interned strings (IDs are below it)*/
+size_t intern_count(void)
+{
+    return string_count;
+}
+
+/*Free every interned string*/
+void intern_free(void)
+{
+    while (chunks)
+    {
+        chunk_t *c = chunks;
+        chunks = c->next;
+        free(c);
+    }
+    free(strings);
+    free(hashes);
+    free(slots);
+    strings = NULL;
+    hashes = NULL;
+    slots = NULL;
+    string_count = 0;
+    string_cap = 0;
+    slot_cap = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/*Identifier of no interned string*/
+#define INTERN_NONE ((size_t)-1)
+
+/*
+ * Global string table: each distinct name is stored once and gets a dense
+ * ID, so equal names share one pointer and compare by pointer or ID.
+ */
+size_t intern(const char *str);
+size_t intern_find(const char *str);
+const char *intern_name(size_t id);
+const char *intern_str(const char *str);
+size_t intern_count(void);
+void intern_free(void);
+
+#endif /*INTERN_H*/
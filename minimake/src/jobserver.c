@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "jobserver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+/*Token pool shared with sub-makes (GNU make jobserver protocol)*/
+static int js_read = -1; /*Shared read end, inherited by children*/
+static int js_write = -1; /*Shared write end, inherited by children*/
+static int js_private = -1; /*Our own non-blocking view of the read end*/
+static char *js_fifo = NULL; /*FIFO path when we created a named pool*/
+static char *held = NULL; /*Token bytes we currently hold*/
+static size_t held_count = 0;
+static size_t held_cap = 0;
+
+/*Open a private non-blocking reader so other clients keep blocking reads*/
+static int open_private_reader(int fd)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    int priv = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (priv < 0)
+    {
+        priv = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+    return priv;
+}
+
+/*Rebuild MAKEFLAGS with our jobserver options, keeping the other flags*/
+static void export_makeflags(const char *auth, int jobs)
+{
+    const char *old = getenv("MAKEFLAGS");
+    size_t count = 0;
+    char **words = split_whitespace(old ? old : "", &count);
+    size_t cap = strlen(auth) + 64;
+    for (size_t i = 0; i < count; i++)
+    {
+        cap += strlen(words[i]) + 1;
+    }
+    char *flags = malloc(cap);
+    if (!flags)
+    {
+        error_exit("Memory allocation failed");
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strncmp(words[i], "--jobserver", 11) != 0
+            && strncmp(words[i], "-j", 2) != 0)
+        {
+            pos += sprintf(flags + pos, "%s ", words[i]);
+        }
+        free(words[i]);
+    }
+    free(words);
+    sprintf(flags + pos, "-j%d --jobserver-auth=%s", jobs, auth);
+    setenv("MAKEFLAGS", flags, 1);
+    free(flags);
+}
+
+/*Give back every token we still hold*/
+static void return_held_tokens(void)
+{
+    while (held_count > 0)
+    {
+        jobserver_release();
+    }
+}
+
+/*Create the token pool for -jN and advertise it to children*/
+int jobserver_server_init(int jobs, int use_fifo)
+{
+    char auth[128];
+    if (use_fifo)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/minimake-jobserver-%ld",
+                 (long)getpid());
+        unlink(path);
+        if (mkfifo(path, 0600) != 0)
+        {
+            error_msg("cannot create jobserver fifo");
+            return 2;
+        }
+        js_fifo = string_duplicate(path);
+        js_read = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        js_write = open(path, O_WRONLY | O_CLOEXEC);
+        snprintf(auth, sizeof(auth), "fifo:%s", path);
+    }
+    else
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            error_msg("cannot create jobserver pipe");
+            return 2;
+        }
+        js_read = fds[0];
+        js_write = fds[1];
+        snprintf(auth, sizeof(auth), "%d,%d", js_read, js_write);
+    }
+    if (js_read < 0 || js_write < 0)
+    {
+        error_msg("cannot open jobserver");
+        return 2;
+    }
+    js_private = use_fifo ? js_read : open_private_reader(js_read);
+    /*One implicit token is ours: put the other jobs-1 in the pool*/
+    for (int i = 1; i < jobs; i++)
+    {
+        if (write(js_write, "+", 1) != 1)
+        {
+            error_msg("cannot fill jobserver pool");
+            return 2;
+        }
+    }
+    export_makeflags(auth, jobs);
+    atexit(jobserver_free);
+    return 0;
+}
+
+/*Join the token pool of a parent make found in MAKEFLAGS*/
+int jobserver_client_init(void)
+{
+    const char *flags = getenv("MAKEFLAGS");
+    if (!flags)
+    {
+        return 0;
+    }
+    /*The last --jobserver-auth (or legacy --jobserver-fds) wins*/
+    const char *auth = NULL;
+    for (const char *p = flags; (p = strstr(p, "--jobserver-")); p++)
+    {
+        if (strncmp(p, "--jobserver-auth=", 17) == 0)
+        {
+            auth = p + 17;
+        }
+        else if (strncmp(p, "--jobserver-fds=", 16) == 0)
+        {
+            auth = p + 16;
+        }
+    }
+    if (!auth)
+    {
+        return 0;
+    }
+    if (strncmp(auth, "fifo:", 5) == 0)
+    {
+        size_t len = strcspn(auth + 5, " \t");
+        char *path = string_duplicate(auth + 5);
+        path[len] = '\0';
+        js_read = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        js_write = open(path, O_WRONLY | O_CLOEXEC);
+        free(path);
+        js_private = js_read;
+    }
+    else if (sscanf(auth, "%d,%d", &js_read, &js_write) == 2
+             && fcntl(js_read, F_GETFD) >= 0 && fcntl(js_write, F_GETFD) >= 0)
+    {
+        js_private = open_private_reader(js_read);
+    }
+    else
+    {
+        js_read = -1;
+        js_write = -1;
+    }
+    if (js_private < 0 || js_write < 0)
+    {
+        error_msg("warning: jobserver unavailable: using -j1");
+        js_read = -1;
+        js_write = -1;
+        js_private = -1;
+        return 0;
+    }
+    atexit(jobserver_free);
+    return 1;
+}
+
+/*Check whether a token pool is in use*/
+int jobserver_active(void)
+{
+    return js_private >= 0;
+}
+
+/*Wait up to timeout_ms for a token; return 1 if one was taken*/
+int jobserver_acquire(int timeout_ms)
+{
+    if (js_private < 0)
+    {
+        return 0;
+    }
+    struct pollfd pfd = { .fd = js_private, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+    {
+        return 0;
+    }
+    char token;
+    /*Another client may have won the race: EAGAIN just means retry*/
+    if (read(js_private, &token, 1) != 1)
+    {
+        return 0;
+    }
+    if (held_count >= held_cap)
+    {
+        held_cap = held_cap ? held_cap * 2 : 8;
+        held = realloc(held, held_cap);
+        if (!held)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    held[held_count++] = token;
+    return 1;
+}
+
+/*Put one previously acquired token back into the pool*/
+void jobserver_release(void)
+{
+    if (held_count == 0)
+    {
+        return;
+    }
+    char token = held[--held_count];
+    while (write(js_write, &token, 1) < 0 && errno == EINTR)
+    {
+        continue;
+    }
+}
+
+/*Return tokens and close the pool (also run at exit)*/
+void jobserver_free(void)
+{
+    return_held_tokens();
+    if (js_private >= 0 && js_private != js_read)
+    {
+        close(js_private);
+    }
+    if (js_fifo)
+    {
+        close(js_read);
+        close(js_write);
+        unlink(js_fifo);
+        free(js_fifo);
+        js_fifo = NULL;
+    }
+    js_private = -1;
+    js_read = -1;
+    js_write = -1;
+    free(held);
+    held = NULL;
+    held_cap = 0;
+}
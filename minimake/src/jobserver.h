@@ -0,0 +1,11 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+int jobserver_server_init(int jobs, int use_fifo);
+int jobserver_client_init(void);
+int jobserver_active(void);
+int jobserver_acquire(int timeout_ms);
+void jobserver_release(void);
+void jobserver_free(void);
+
+#endif /*JOBSERVER_H*/
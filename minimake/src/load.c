@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "load.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*Minimum delay between two reads of /proc (milliseconds)*/
+#define LOAD_SAMPLE_MS 250
+
+/*Limits given on the command line (0 = no limit)*/
+static double load_limit = 0; /*-l: runnable processes*/
+static long headroom_kb = 0; /*--mem-headroom: MemAvailable to keep*/
+static double pressure_limit = 0; /*--mem-pressure: PSI some avg10*/
+
+/*Last sample of the system state*/
+static int sampled = 0;
+static struct timespec sample_time;
+static double sample_load = 0;
+static long sample_avail_kb = 0;
+static double sample_pressure = 0;
+static unsigned recent_jobs = 0; /*Jobs started since the last sample*/
+
+/*Set the throttling limits*/
+void load_set_limits(double max_load, long headroom_mb, double max_pressure)
+{
+    load_limit = max_load;
+    headroom_kb = headroom_mb * 1024;
+    pressure_limit = max_pressure;
+}
+
+/*Check whether any limit is set*/
+int load_throttling(void)
+{
+    return load_limit > 0 || headroom_kb > 0 || pressure_limit > 0;
+}
+
+/*Read the load: runnable processes now, else the 1-minute average*/
+static double read_load(void)
+{
+    FILE *f = fopen("/proc/loadavg", "r");
+    if (!f)
+    {
+        return 0;
+    }
+    double avg1 = 0;
+    int running = 0;
+    int total = 0;
+    int n = fscanf(f, "%lf %*f %*f %d/%d", &avg1, &running, &total);
+    fclose(f);
+    if (n == 3)
+    {
+        return running > 0 ? running - 1 : 0; /*Do not count ourselves*/
+    }
+    return n >= 1 ? avg1 : 0;
+}
+
+/*Read MemAvailable from /proc/meminfo, in kB (-1 if unknown)*/
+static long read_avail_kb(void)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f)
+    {
+        return -1;
+    }
+    char line[256];
+    long avail = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "MemAvailable: %ld kB", &avail) == 1)
+        {
+            break;
+        }
+    }
+    fclose(f);
+    return avail;
+}
+
+/*Read the PSI memory "some avg10" percentage (0 if unavailable)*/
+static double read_pressure(void)
+{
+    FILE *f = fopen("/proc/pressure/memory", "r");
+    if (!f)
+    {
+        return 0;
+    }
+    double avg10 = 0;
+    if (fscanf(f, "some avg10=%lf", &avg10) != 1)
+    {
+        avg10 = 0;
+    }
+    fclose(f);
+    return avg10;
+}
+
+/*Refresh the sample if the previous one is too old*/
+static void sample(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ms = (now.tv_sec - sample_time.tv_sec) * 1000
+        + (now.tv_nsec - sample_time.tv_nsec) / 1000000;
+    if (sampled && elapsed_ms < LOAD_SAMPLE_MS)
+    {
+        return;
+    }
+    if (load_limit > 0)
+    {
+        sample_load = read_load();
+    }
+    if (headroom_kb > 0)
+    {
+        sample_avail_kb = read_avail_kb();
+    }
+    if (pressure_limit > 0)
+    {
+        sample_pressure = read_pressure();
+    }
+    sample_time = now;
+    sampled = 1;
+    recent_jobs = 0;
+}
+
+/*Check whether the machine can take one more job right now*/
+int load_allows_job(void)
+{
+    if (!load_throttling())
+    {
+        return 1;
+    }
+    sample();
+    /*Jobs started since the sample are not visible in /proc yet*/
+    if (load_limit > 0 && sample_load + recent_jobs >= load_limit)
+    {
+        return 0;
+    }
+    if (headroom_kb > 0 && sample_avail_kb >= 0
+        && sample_avail_kb < headroom_kb)
+    {
+        return 0;
+    }
+    if (pressure_limit > 0 && sample_pressure >= pressure_limit)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/*Account for a job launched since the last sample*/
+void load_job_started(void)
+{
+    recent_jobs++;
+}
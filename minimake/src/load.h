@@ -0,0 +1,9 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+void load_set_limits(double max_load, long headroom_mb, double max_pressure);
+int load_throttling(void);
+int load_allows_job(void);
+void load_job_started(void);
+
+#endif /*LOAD_H*/
@@ -1,16 +1,40 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "executor.h"
+#include "export.h"
+#include "functions.h"
+#include "intern.h"
+#include "jobserver.h"
+#include "load.h"
 #include "parser.h"
 #include "rules.h"
+#include "stats.h"
+#include "supervisor.h"
 #include "variables.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /* Structure to hold command-line options */
 typedef struct {
     char *makefile;         /* -f option: makefile name */
     int pretty;             /* -p option: pretty-print mode */
+    int export_format;      /* --export: EXPORT_JSON, _DOT or _BINARY */
     int help;               /* -h option: show help */
+    int jobs;               /* -j option: job slots (0 = unlimited) */
+    int jobserver_fifo;     /* --jobserver-style=fifo */
+    int restat;             /* --restat[=digest]: re-check outputs */
+    double max_load;        /* -l option: load limit (0 = none) */
+    double timeout;         /* --timeout: seconds per recipe (0 = none) */
+    long mem_headroom;      /* --mem-headroom: MiB to keep available */
+    double mem_pressure;    /* --mem-pressure: PSI avg10 limit */
+    int stats;              /* --stats[=json]: 1 table, 2 JSON */
+    int keep_going;         /* -k: continue after a failed recipe */
+    int run_mode;           /* -q / -n: RUN_QUESTION or RUN_DRY */
+    char **dirs;            /* -C options: directories to enter */
+    size_t dir_count;       /* Number of -C options */
     char **targets;         /* List of targets to build */
     size_t target_count;    /* Number of targets */
 } options_t;
@@ -21,6 +45,32 @@ static void print_help(void) {
     printf("Options:\n");
     printf("  -f FILE    Use FILE as makefile\n");
     printf("  -p         Pretty-print the makefile\n");
+    printf("  -k         Keep going: build what does not depend on a failure\n");
+    printf("  -n         Print the recipes that would run, run nothing\n");
+    printf("  -q         Run nothing; exit 1 if a target is out of date\n");
+    printf("  -C DIR     Change to DIR before doing anything\n");
+    printf("  -j [N]     Run N recipes at once (no N: unlimited)\n");
+    printf("  -l [LOAD]  Start no new job while the load is above LOAD (no LOAD: none)\n");
+    printf("  --mem-headroom=MB\n");
+    printf("             Start no new job while less than MB MiB are available\n");
+    printf("  --mem-pressure=PCT\n");
+    printf("             Start no new job while memory pressure is above PCT\n");
+    printf("  --timeout=SECONDS\n");
+    printf("             Kill a recipe still running after SECONDS and fail\n");
+    printf("  --export=json|dot|binary\n");
+    printf("             Like -p, but write the resolved dependency graph\n");
+    printf("             and the variables in a machine-readable format\n");
+    printf("  --stats[=json]\n");
+    printf("             Print execution statistics at exit, as a table\n");
+    printf("             or as JSON\n");
+    printf("  --restat[=digest]\n");
+    printf("             Outputs left unchanged by their recipe (same mtime,\n");
+    printf("             or same content) do not make dependents stale;\n");
+    printf("             .RESTAT: TARGETS enables it for some targets only;\n");
+    printf("             later runs see it through .minimake_restat\n");
+    printf("  --jobserver-style=fifo|pipe\n");
+    printf("             Share job slots with sub-makes through a named fifo\n");
+    printf("             or an anonymous pipe (default)\n");
     printf("  -h         Display this help\n");
 }
 
@@ -35,12 +85,66 @@ static int check_empty_args(int argc, char **argv) {
     return 0;
 }
 
+/* Check if a string is a non-empty run of digits */
+static int is_number(const char *str) {
+    if (*str == '\0')
+        return 0;
+    for (; *str; str++) {
+        if (*str < '0' || *str > '9')
+            return 0;
+    }
+    return 1;
+}
+
+/* Check if a string is a decimal number, like a -l load */
+static int is_decimal(const char *str) {
+    int digits = 0;
+    int points = 0;
+    for (; *str; str++) {
+        if (*str == '.')
+            points++;
+        else if (*str >= '0' && *str <= '9')
+            digits++;
+        else
+            return 0;
+    }
+    return digits > 0 && points <= 1;
+}
+
+/* Parse a load limit, refusing anything but a number */
+static double parse_load(const char *str) {
+    if (!is_decimal(str))
+        error_exit("invalid load average");
+    return atof(str);
+}
+
+/* Append a directory to the -C list */
+static void add_dir(options_t *opts, char *dir) {
+    opts->dirs = realloc(opts->dirs, sizeof(char *) * (opts->dir_count + 1));
+    if (!opts->dirs)
+        error_exit("Memory allocation failed");
+    opts->dirs[opts->dir_count++] = dir;
+}
+
 /* Parse command-line arguments */
 static void parse_args(int argc, char **argv, options_t *opts) {
     /* Initialize options */
     opts->makefile = NULL;
     opts->pretty = 0;
     opts->help = 0;
+    opts->jobs = -1;
+    opts->jobserver_fifo = 0;
+    opts->restat = RESTAT_OFF;
+    opts->max_load = 0;
+    opts->timeout = 0;
+    opts->mem_headroom = 0;
+    opts->mem_pressure = 0;
+    opts->stats = 0;
+    opts->export_format = EXPORT_TEXT;
+    opts->keep_going = 0;
+    opts->run_mode = RUN_BUILD;
+    opts->dirs = NULL;
+    opts->dir_count = 0;
     opts->targets = NULL;
     opts->target_count = 0;
     
@@ -48,8 +152,66 @@ static void parse_args(int argc, char **argv, options_t *opts) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0) {
             opts->help = 1;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            opts->run_mode = RUN_QUESTION;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            opts->run_mode = RUN_DRY;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            opts->keep_going = 1;
         } else if (strcmp(argv[i], "-p") == 0) {
             opts->pretty = 1;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            /* Optional count in the next argument */
+            opts->jobs = 0;
+            if (i + 1 < argc && is_number(argv[i + 1]))
+                opts->jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && is_number(argv[i] + 2)) {
+            opts->jobs = atoi(argv[i] + 2);
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0
+                   && is_number(argv[i] + 7)) {
+            opts->jobs = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            /* Optional limit in the next argument; bare -l clears it */
+            opts->max_load = 0;
+            if (i + 1 < argc && is_decimal(argv[i + 1]))
+                opts->max_load = atof(argv[++i]);
+        } else if (strncmp(argv[i], "-l", 2) == 0) {
+            opts->max_load = parse_load(argv[i] + 2);
+        } else if (strncmp(argv[i], "--load-average=", 15) == 0) {
+            opts->max_load = parse_load(argv[i] + 15);
+        } else if (strncmp(argv[i], "--mem-headroom=", 15) == 0) {
+            opts->mem_headroom = atol(argv[i] + 15);
+        } else if (strncmp(argv[i], "--mem-pressure=", 15) == 0) {
+            opts->mem_pressure = atof(argv[i] + 15);
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            opts->timeout = atof(argv[i] + 10);
+        } else if (strcmp(argv[i], "--export=json") == 0) {
+            opts->pretty = 1;
+            opts->export_format = EXPORT_JSON;
+        } else if (strcmp(argv[i], "--export=dot") == 0) {
+            opts->pretty = 1;
+            opts->export_format = EXPORT_DOT;
+        } else if (strcmp(argv[i], "--export=binary") == 0) {
+            opts->pretty = 1;
+            opts->export_format = EXPORT_BINARY;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            opts->stats = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            opts->stats = 2;
+        } else if (strcmp(argv[i], "--restat") == 0) {
+            opts->restat = RESTAT_MTIME;
+        } else if (strcmp(argv[i], "--restat=digest") == 0) {
+            opts->restat = RESTAT_DIGEST;
+        } else if (strcmp(argv[i], "--jobserver-style=fifo") == 0) {
+            opts->jobserver_fifo = 1;
+        } else if (strcmp(argv[i], "--jobserver-style=pipe") == 0) {
+            opts->jobserver_fifo = 0;
+        } else if (strcmp(argv[i], "-C") == 0) {
+            /* Next argument is a directory */
+            if (i + 1 < argc)
+                add_dir(opts, argv[++i]);
+        } else if (strncmp(argv[i], "-C", 2) == 0) {
+            add_dir(opts, argv[i] + 2);
         } else if (strcmp(argv[i], "-f") == 0) {
             /* Next argument is filename */
             if (i + 1 < argc) {
@@ -75,10 +237,44 @@ static char *find_makefile(void) {
     return NULL;
 }
 
+/* Enter the -C directories, each relative to the previous one */
+static void change_dirs(options_t *opts) {
+    for (size_t i = 0; i < opts->dir_count; i++) {
+        if (chdir(opts->dirs[i]) != 0) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "%s: No such file or directory",
+                     opts->dirs[i]);
+            error_exit(msg);
+        }
+    }
+}
+
+/* Set up job slots: own token pool for -jN, else join a parent's */
+static int setup_jobs(options_t *opts) {
+    load_set_limits(opts->max_load, opts->mem_headroom, opts->mem_pressure);
+    executor_set_timeout(opts->timeout);
+    if (opts->jobs > 1) {
+        const char *flags = getenv("MAKEFLAGS");
+        if (flags && strstr(flags, "--jobserver"))
+            error_msg("warning: -j forced in submake: resetting jobserver mode.");
+        if (jobserver_server_init(opts->jobs, opts->jobserver_fifo) != 0)
+            return 2;
+        rules_set_parallel(1);
+    } else if (opts->jobs == 0) {
+        /* Unlimited: no token pool to share */
+        rules_set_parallel(1);
+    } else if (opts->jobs < 0 && jobserver_client_init()) {
+        rules_set_parallel(1);
+    }
+    return 0;
+}
+
 /* Main minimake logic */
 static int run_minimake(options_t *opts) {
     char *makefile = opts->makefile;
     
+    change_dirs(opts);
+    
     /* Auto-detect makefile if not specified */
     if (!makefile) {
         makefile = find_makefile();
@@ -96,17 +292,30 @@ static int run_minimake(options_t *opts) {
     /* Initialize systems */
     variable_init();
     rules_init();
+    rules_set_restat(opts->restat);
+    rules_set_keep_going(opts->keep_going);
+    rules_set_run_mode(opts->run_mode);
+    /* Nothing changes files under -q and -n: stat each path once */
+    if (opts->run_mode != RUN_BUILD)
+        stat_cache_enable();
     
     /* Parse the makefile */
+    stats_phase(PHASE_PARSE);
     if (parse_makefile(makefile) != 0)
         return 2;
+    stats_phase(PHASE_EVAL);
     
     /* Handle pretty-print mode */
     if (opts->pretty) {
+        if (opts->export_format != EXPORT_TEXT)
+            return export_graph(opts->export_format);
         pretty_print();
         return 0;
     }
     
+    if (setup_jobs(opts) != 0)
+        return 2;
+    
     /* Build targets */
     if (opts->target_count == 0) {
         /* No targets specified: build default (first) rule */
@@ -116,13 +325,18 @@ static int run_minimake(options_t *opts) {
         return build_target(def->target);
     }
     
-    /* Build each specified target in order */
+    /* Build each specified target in order (all of them with -k) */
+    int ret = 0;
     for (size_t i = 0; i < opts->target_count; i++) {
-        if (build_target(opts->targets[i]) != 0)
-            return 2;
+        int status = build_target(opts->targets[i]);
+        if (status != 0) {
+            if (!opts->keep_going)
+                return status;
+            ret = status;
+        }
     }
     
-    return 0;
+    return ret;
 }
 
 /* Main entry point */
@@ -141,13 +355,22 @@ int main(int argc, char **argv) {
         return 0;
     }
     
+    if (opts.stats)
+        stats_enable(opts.stats == 2);
+    
     /* Run minimake */
     int ret = run_minimake(&opts);
     
     /* Cleanup */
     variable_free();
+    functions_free();
     rules_free();
+    supervisor_free();
+    stat_cache_free();
+    intern_free();
+    jobserver_free();
     free(opts.targets);
+    free(opts.dirs);
     
     return ret;
 }
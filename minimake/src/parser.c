@@ -7,14 +7,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "intern.h"
 #include "rules.h"
 #include "utils.h"
 #include "variables.h"
 
-/*Store parsed rules for pretty-print*/
-static rule_t **parsed_rules = NULL;
-static size_t parsed_count = 0;
-
 /*Remove comments from a line (everything after #)*/
 static char *remove_comment(char *line)
 {
@@ -26,11 +23,37 @@ static char *remove_comment(char *line)
     return line;
 }
 
+/*Remove the trailing newline kept by getline*/
+static char *remove_newline(char *line)
+{
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    {
+        line[--len] = '\0';
+    }
+    return line;
+}
+
+/*Find the assignment operator (=, :=, ::=, ?=, +=) of a line*/
+static char *find_assign_op(const char *line, char *equals)
+{
+    char *op = equals;
+    if (op > line && (op[-1] == '?' || op[-1] == '+' || op[-1] == ':'))
+    {
+        op--;
+        if (*op == ':' && op > line && op[-1] == ':')
+        {
+            op--; /*::=*/
+        }
+    }
+    return op;
+}
+
 /*Check if line is a rule (contains : before =)*/
 static int is_rule_line(const char *line)
 {
     const char *colon = strchr(line, ':');
-    const char *equals = strchr(line, '=');
+    char *equals = strchr(line, '=');
     if (!colon)
     {
         return 0; /*No colon = not a rule*/
@@ -39,23 +62,71 @@ static int is_rule_line(const char *line)
     {
         return 1; /*Colon but no = = rule*/
     }
-    return colon < equals; /*: before = = rule*/
+    /*The colon of := and ::= belongs to the assignment*/
+    return colon < find_assign_op(line, equals); /*: before = = rule*/
 }
 
-/*Parse a variable definition (VAR = value)*/
-static void parse_variable_def(char *line)
+/*Parse a variable definition (VAR = value, :=, ::=, ?=, +=)*/
+static void parse_variable_def(char *line, int export)
 {
     char *equals = strchr(line, '=');
     if (!equals)
     {
         return;
     }
-    /*Split at = sign*/
-    *equals = '\0';
+    /*Split at the operator*/
+    char *op_start = find_assign_op(line, equals);
+    char op[4];
+    size_t op_len = equals - op_start + 1;
+    memcpy(op, op_start, op_len);
+    op[op_len] = '\0';
+    *op_start = '\0';
     char *name = trim_whitespace(line);
     char *value = trim_whitespace(equals + 1);
     /*Store variable*/
-    variable_set(name, value);
+    variable_assign(name, op, value);
+    if (export)
+    {
+        char *exp_name = variable_expand(name);
+        variable_export(exp_name);
+        free(exp_name);
+    }
+}
+
+/*Check for an export line, return what follows the keyword*/
+static char *export_args(char *line)
+{
+    if (strncmp(line, "export", 6) != 0
+        || (line[6] != '\0' && !isblank((unsigned char)line[6])))
+    {
+        return NULL;
+    }
+    return trim_whitespace(line + 6);
+}
+
+/*Parse export, export VAR... or export VAR = value*/
+static void parse_export(char *args)
+{
+    if (*args == '\0')
+    {
+        variable_export_all();
+        return;
+    }
+    if (strchr(args, '='))
+    {
+        parse_variable_def(args, 1);
+        return;
+    }
+    char *names = variable_expand(args);
+    size_t count = 0;
+    char **words = split_whitespace(names, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        variable_export(words[i]);
+        free(words[i]);
+    }
+    free(words);
+    free(names);
 }
 
 /*Add a command line to a rule's recipe*/
@@ -83,7 +154,7 @@ static void parse_recipe(FILE *f, rule_t *rule)
             break;
         }
         /*Remove comments but keep the line*/
-        char *cleaned = remove_comment(line);
+        char *cleaned = remove_comment(remove_newline(line));
         if (cleaned[0] == '\t')
         {
             add_recipe_line(rule, cleaned);
@@ -112,16 +183,24 @@ static void parse_rule_line(char *line, FILE *f)
     /*Parse dependencies*/
     char *deps_str = trim_whitespace(colon + 1);
     char *exp_deps = variable_expand(deps_str);
-    /*Split dependencies by whitespace*/
-    rule->dependencies = split_whitespace(exp_deps, &rule->dep_count);
+    /*Split dependencies by whitespace, sharing one copy of each name*/
+    char **words = split_whitespace(exp_deps, &rule->dep_count);
     free(exp_deps);
+    rule->dependencies = malloc(sizeof(char *) * (rule->dep_count + 1));
+    if (!rule->dependencies)
+    {
+        error_exit("Memory allocation failed");
+    }
+    for (size_t i = 0; i < rule->dep_count; i++)
+    {
+        rule->dependencies[i] = intern_str(words[i]);
+        free(words[i]);
+    }
+    free(words);
     /*Parse recipe commands*/
     parse_recipe(f, rule);
-    /*Add rule to list*/
+    /*Add rule to the rules table*/
     rule_add(rule);
-    /*Store for pretty-print*/
-    parsed_rules = realloc(parsed_rules, sizeof(rule_t *) * (parsed_count + 1));
-    parsed_rules[parsed_count++] = rule;
 }
 
 /*Main parsing function - read and parse makefile*/
@@ -141,21 +220,26 @@ int parse_makefile(const char *filename)
     while (getline(&line, &len, f) != -1)
     {
         /*Remove comments*/
-        char *cleaned = remove_comment(line);
+        char *cleaned = remove_comment(remove_newline(line));
         char *trimmed = trim_whitespace(cleaned);
         /*Skip empty lines*/
         if (strlen(trimmed) == 0)
         {
             continue;
         }
-        /*Parse rule or variable*/
-        if (is_rule_line(trimmed))
+        /*Parse export, rule or variable*/
+        char *args = export_args(trimmed);
+        if (args)
+        {
+            parse_export(args);
+        }
+        else if (is_rule_line(trimmed))
         {
             parse_rule_line(trimmed, f);
         }
         else if (strchr(trimmed, '='))
         {
-            parse_variable_def(trimmed);
+            parse_variable_def(trimmed, 0);
         }
     }
     free(line);
@@ -167,10 +251,20 @@ int parse_makefile(const char *filename)
 void pretty_print(void)
 {
     printf("# variables\n");
+    size_t var_count;
+    variable_t **vars = variables_all(&var_count);
+    for (size_t i = 0; i < var_count; i++)
+    {
+        printf("(%s) %s [%s]\n", vars[i]->name,
+               vars[i]->flavor == VAR_SIMPLE ? ":=" : "=", vars[i]->value);
+    }
+    free(vars);
     printf("\n# rules\n");
-    for (size_t i = 0; i < parsed_count; i++)
+    size_t count;
+    rule_t **rules = rules_all(&count);
+    for (size_t i = 0; i < count; i++)
     {
-        rule_t *r = parsed_rules[i];
+        rule_t *r = rules[i];
         /*Print target and dependencies*/
         printf("(%s):", r->target);
         for (size_t j = 0; j < r->dep_count; j++)
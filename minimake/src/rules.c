@@ -1,26 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "rules.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "executor.h"
+#include "graph.h"
+#include "intern.h"
+#include "jobserver.h"
+#include "load.h"
+#include "stats.h"
 #include "utils.h"
 #include "variables.h"
 
+/*Restat log: outputs whose recipe left their content unchanged*/
+#define RESTAT_LOG ".minimake_restat"
+
+/*Restat log entry of an output, valid while the output keeps its mtime*/
+typedef struct restat_entry {
+    time_t mtime; /*Output mtime when logged (0: no entry)*/
+    time_t content; /*Mtime of the content, for its dependents*/
+    time_t inputs; /*Newest dependency the output was checked against*/
+} restat_entry_t;
+
 /*Global variables for rule management*/
-static rule_t *rules_head = NULL; /*Head of rules list*/
-static rule_t *phony_rule = NULL; /*Special .PHONY rule*/
-static char **built_targets = NULL; /*Targets already built*/
-static size_t built_count = 0; /*Number of built targets*/
+static rule_t **rules = NULL; /*Every rule, in definition order*/
+static size_t rule_count = 0;
+static size_t rule_cap = 0;
+static unsigned char *phony_set = NULL; /*Phony flag by string ID*/
+static size_t phony_cap = 0;
+static rule_t **restat_rules = NULL; /*Special .RESTAT rules*/
+static size_t restat_count = 0;
+static size_t restat_cap = 0;
+static int restat_mode = RESTAT_OFF; /*--restat: applies to every rule*/
+static restat_entry_t *restat_log = NULL; /*Restat log by string ID*/
+static size_t restat_log_cap = 0;
+static int restat_log_loaded = 0;
+static int parallel = 0; /*Run independent recipes concurrently*/
+static int run_mode = RUN_BUILD; /*-q and -n execute no recipe*/
+static int question_stale = 0; /*-q found a target to remake*/
+static int keep_going = 0; /*-k: build what does not depend on a failure*/
+static int build_failed = 0; /*A recipe failed: start nothing new*/
+static rule_t **failed = NULL; /*Rules whose recipe failed, in order*/
+static size_t failed_count = 0;
+static size_t failed_cap = 0;
+static size_t failed_reported = 0; /*Failures already reported*/
+static size_t tokens_held = 0; /*Jobserver tokens held by running jobs*/
+static rule_t **waiting = NULL; /*Rules whose dependencies still run*/
+static size_t waiting_count = 0;
+static size_t waiting_cap = 0;
+static size_t woken_count = 0; /*Waiting rules with a settled dependency*/
+
+/*Delay between two checks for a free job slot (milliseconds)*/
+#define SLOT_POLL_MS 20
 
 /*Initialize the rules system*/
 void rules_init(void)
 {
-    rules_head = NULL;
-    phony_rule = NULL;
-    built_targets = NULL;
-    built_count = 0;
+    rules = NULL;
+    rule_count = 0;
+    rule_cap = 0;
+    phony_set = NULL;
+    phony_cap = 0;
+    restat_rules = NULL;
+    restat_count = 0;
+    restat_cap = 0;
+    restat_mode = RESTAT_OFF;
+    restat_log = NULL;
+    restat_log_cap = 0;
+    restat_log_loaded = 0;
+    parallel = 0;
+    run_mode = RUN_BUILD;
+    question_stale = 0;
+    keep_going = 0;
+    build_failed = 0;
+    failed = NULL;
+    failed_count = 0;
+    failed_cap = 0;
+    failed_reported = 0;
+    tokens_held = 0;
+    waiting = NULL;
+    waiting_count = 0;
+    waiting_cap = 0;
+    woken_count = 0;
+    graph_init();
+}
+
+/*Enable concurrent recipes (-j or a parent jobserver)*/
+void rules_set_parallel(int enable)
+{
+    parallel = enable;
+}
+
+/*Only check freshness (-q) or only print recipes (-n)*/
+void rules_set_run_mode(int mode)
+{
+    run_mode = mode;
+}
+
+/*Keep building unrelated targets after a recipe fails (-k)*/
+void rules_set_keep_going(int enable)
+{
+    keep_going = enable;
+}
+
+/*Re-check outputs after their recipe ran (--restat[=digest])*/
+void rules_set_restat(int mode)
+{
+    restat_mode = mode;
 }
 
 /*Create a new rule structure*/
@@ -31,98 +122,343 @@ rule_t *rule_create(const char *target)
     {
         error_exit("Memory allocation failed");
     }
-    r->target = string_duplicate(target);
+    r->id = GRAPH_NONE;
+    r->target = intern_str(target);
     r->dependencies = NULL;
     r->dep_count = 0;
     r->recipe = NULL;
     r->recipe_count = 0;
     r->is_pattern = (strchr(target, '%') != NULL);
     r->is_phony = 0;
-    r->next = NULL;
+    r->state = BUILD_NONE;
     return r;
 }
 
-/*Add a rule to the rules list*/
+/*Append a rule pointer to a growable array*/
+static void rule_array_push(rule_t ***array, size_t *count, size_t *cap,
+                            rule_t *rule)
+{
+    if (*count >= *cap)
+    {
+        *cap = *cap ? *cap * 2 : 16;
+        *array = realloc(*array, sizeof(rule_t *) * *cap);
+        if (!*array)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    (*array)[(*count)++] = rule;
+}
+
+/*Add the prerequisites of a .PHONY rule to the phony set*/
+static void add_phony(rule_t *rule)
+{
+    for (size_t i = 0; i < rule->dep_count; i++)
+    {
+        size_t id = intern(rule->dependencies[i]);
+        if (id >= phony_cap)
+        {
+            size_t cap = phony_cap ? phony_cap : 64;
+            while (cap <= id)
+            {
+                cap *= 2;
+            }
+            phony_set = realloc(phony_set, cap);
+            if (!phony_set)
+            {
+                error_exit("Memory allocation failed");
+            }
+            memset(phony_set + phony_cap, 0, cap - phony_cap);
+            phony_cap = cap;
+        }
+        phony_set[id] = 1;
+    }
+}
+
+/*Add a rule to the rules table and the dependency graph*/
 void rule_add(rule_t *rule)
 {
-    /*.PHONY is a special rule*/
+    rule_array_push(&rules, &rule_count, &rule_cap, rule);
+    /*.PHONY is a special rule: every declaration adds to the set*/
     if (strcmp(rule->target, ".PHONY") == 0)
     {
-        phony_rule = rule;
+        add_phony(rule);
         return;
     }
-
-    /*Add to front of list*/
-    rule->next = rules_head;
-    rules_head = rule;
+    /*.RESTAT rules are kept together, every declaration counts*/
+    if (strcmp(rule->target, ".RESTAT") == 0)
+    {
+        rule_array_push(&restat_rules, &restat_count, &restat_cap, rule);
+        return;
+    }
+    /*A later definition of a target replaces the earlier one*/
+    if (!rule->is_pattern)
+    {
+        rule->id = graph_intern(rule->target);
+        graph_set_rule(rule->id, rule);
+    }
 }
 
 /*Find a non-pattern rule by target name*/
 rule_t *rule_find(const char *target)
 {
-    for (rule_t *r = rules_head; r; r = r->next)
+    STATS_INC(rule_lookups);
+    size_t id = graph_lookup(target);
+    return id == GRAPH_NONE ? NULL : graph_rule(id);
+}
+
+/*Get every rule, in definition order*/
+rule_t **rules_all(size_t *count)
+{
+    *count = rule_count;
+    return rules;
+}
+
+/*Get the first non-pattern rule (default target)*/
+rule_t *rule_get_default(void)
+{
+    for (size_t i = 0; i < rule_count; i++)
     {
-        if (!r->is_pattern && strcmp(r->target, target) == 0)
+        if (rules[i]->id != GRAPH_NONE)
         {
-            return r;
+            return rules[i];
         }
     }
     return NULL;
 }
 
-/*Get the first non-pattern rule (default target)*/
-rule_t *rule_get_default(void)
+/*Check if target is declared as phony*/
+int rule_is_phony(const char *target)
+{
+    size_t id = intern_find(target);
+    return id < phony_cap && phony_set[id];
+}
+
+/*Get the restat mode of an interned target: --restat, else .RESTAT*/
+static int restat_target_mode(const char *target)
+{
+    if (restat_mode != RESTAT_OFF)
+    {
+        return restat_mode;
+    }
+    for (size_t n = 0; n < restat_count; n++)
+    {
+        rule_t *r = restat_rules[n];
+        for (size_t i = 0; i < r->dep_count; i++)
+        {
+            if (r->dependencies[i] == target)
+            {
+                return RESTAT_DIGEST;
+            }
+        }
+    }
+    return RESTAT_OFF;
+}
+
+/*Entry of a path in the restat log, created on demand*/
+static restat_entry_t *restat_slot(const char *path)
 {
-    for (rule_t *r = rules_head; r; r = r->next)
+    size_t id = intern(path);
+    if (id >= restat_log_cap)
     {
-        if (!r->is_pattern)
+        size_t cap = restat_log_cap ? restat_log_cap : 256;
+        while (cap <= id)
+        {
+            cap *= 2;
+        }
+        restat_log = realloc(restat_log, sizeof(restat_entry_t) * cap);
+        if (!restat_log)
         {
-            return r;
+            error_exit("Memory allocation failed");
         }
+        memset(restat_log + restat_log_cap, 0,
+               sizeof(restat_entry_t) * (cap - restat_log_cap));
+        restat_log_cap = cap;
     }
-    return NULL;
+    return &restat_log[id];
 }
 
-/*Check if target is declared as phony*/
-static int is_phony_target(const char *target)
+/*Append one entry to the log file*/
+static void restat_log_append(FILE *f, const char *path, restat_entry_t *e)
+{
+    fprintf(f, "%lld %lld %lld %s\n", (long long)e->mtime,
+            (long long)e->content, (long long)e->inputs, path);
+}
+
+/*Read the log once; the last line of a path wins. A log holding mostly
+  superseded lines is rewritten with one line per path*/
+static void restat_log_load(void)
 {
-    if (!phony_rule)
+    restat_log_loaded = 1;
+    FILE *f = fopen(RESTAT_LOG, "r");
+    if (!f)
     {
-        return 0;
+        return;
     }
-    /*Check if target is in .PHONY dependencies*/
-    for (size_t i = 0; i < phony_rule->dep_count; i++)
+    char *line = NULL;
+    size_t line_cap = 0;
+    size_t lines = 0;
+    size_t paths = 0;
+    while (getline(&line, &line_cap, f) > 0)
     {
-        if (strcmp(phony_rule->dependencies[i], target) == 0)
+        long long mtime;
+        long long content;
+        long long inputs;
+        int name = 0;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%lld %lld %lld %n", &mtime, &content, &inputs,
+                   &name)
+                < 3
+            || !name || !line[name])
         {
-            return 1;
+            continue;
         }
+        restat_entry_t *e = restat_slot(line + name);
+        paths += e->mtime == 0;
+        lines++;
+        e->mtime = (time_t)mtime;
+        e->content = (time_t)content;
+        e->inputs = (time_t)inputs;
     }
-    return 0;
+    free(line);
+    fclose(f);
+    if (lines > 2 * paths + 64 && (f = fopen(RESTAT_LOG, "w")))
+    {
+        for (size_t id = 0; id < restat_log_cap; id++)
+        {
+            if (restat_log[id].mtime)
+            {
+                restat_log_append(f, intern_name(id), &restat_log[id]);
+            }
+        }
+        fclose(f);
+    }
+}
+
+/*Logged entry of a path, if it still describes the file (mtime given)*/
+static restat_entry_t *restat_lookup(const char *path, time_t mtime)
+{
+    if (!restat_log_loaded)
+    {
+        restat_log_load();
+    }
+    size_t id = intern_find(path);
+    if (id == INTERN_NONE || id >= restat_log_cap || mtime == 0
+        || restat_log[id].mtime != mtime)
+    {
+        return NULL;
+    }
+    return &restat_log[id];
+}
+
+/*Mtime of a dependency as its dependents see it: a rewrite that left
+  the content unchanged does not count*/
+static time_t content_time_at(const char *path, time_t mtime)
+{
+    restat_entry_t *e = restat_lookup(path, mtime);
+    return e ? e->content : mtime;
+}
+
+static time_t content_time(const char *path)
+{
+    return content_time_at(path, get_modification_time(path));
+}
+
+/*is_older() through the restat log: a target is as recent as the inputs
+  it was last checked against*/
+static int restat_older(const char *target, const char *dep)
+{
+    time_t t = get_modification_time(target);
+    time_t d = content_time(dep);
+    if (t == 0 || d == 0)
+    {
+        return 0;
+    }
+    restat_entry_t *e = restat_lookup(target, t);
+    if (e && e->inputs > t)
+    {
+        t = e->inputs;
+    }
+    return t < d;
 }
 
-/*Check if target was already built this run*/
-static int was_built(const char *target)
+/*Log an output whose recipe left its content as it was*/
+static void restat_record(rule_t *rule, time_t mtime, time_t content)
 {
-    for (size_t i = 0; i < built_count; i++)
+    restat_entry_t e;
+    e.mtime = mtime;
+    e.content = content;
+    e.inputs = 0;
+    size_t count;
+    const size_t *deps = graph_deps(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
     {
-        if (strcmp(built_targets[i], target) == 0)
+        rule_t *dep_rule = graph_rule(deps[i]);
+        time_t d = dep_rule && dep_rule->is_phony
+                       ? 0
+                       : content_time(graph_name(deps[i]));
+        if (d > e.inputs)
         {
-            return 1;
+            e.inputs = d;
         }
     }
-    return 0;
+    *restat_slot(rule->target) = e;
+    FILE *f = fopen(RESTAT_LOG, "a");
+    if (f)
+    {
+        restat_log_append(f, rule->target, &e);
+        fclose(f);
+    }
 }
 
-/*Mark target as built (for deduplication)*/
-static void mark_built(const char *target)
+/*Record the output state before its recipe runs*/
+static void restat_begin(rule_t *rule)
 {
-    built_targets = realloc(built_targets, sizeof(char *) * (built_count + 1));
-    if (!built_targets)
+    struct stat st;
+    STATS_INC(stat_calls);
+    rule->restat_existed = stat(rule->target, &st) == 0;
+    if (!rule->restat_existed)
     {
-        error_exit("Memory allocation failed");
+        return;
+    }
+    rule->restat_sec = st.st_mtim.tv_sec;
+    rule->restat_nsec = st.st_mtim.tv_nsec;
+    if (rule->restat == RESTAT_DIGEST
+        && file_digest(rule->target, &rule->restat_digest) != 0)
+    {
+        rule->restat_existed = 0;
+    }
+}
+
+/*After a successful recipe, check whether the output really changed.
+  The output keeps the mtime the recipe gave it, so that it stays newer
+  than its inputs; the log keeps the mtime of the unchanged content for
+  its dependents, in this run and the later ones*/
+static void restat_end(rule_t *rule)
+{
+    struct stat st;
+    STATS_INC(stat_calls);
+    if (!rule->restat_existed || stat(rule->target, &st) != 0)
+    {
+        return;
+    }
+    time_t content = content_time_at(rule->target, rule->restat_sec);
+    if (st.st_mtim.tv_sec == rule->restat_sec
+        && st.st_mtim.tv_nsec == rule->restat_nsec)
+    {
+        rule->unchanged = 1; /*The recipe left the output alone*/
+        restat_record(rule, st.st_mtim.tv_sec, content);
+        return;
+    }
+    unsigned long long digest;
+    if (rule->restat != RESTAT_DIGEST
+        || file_digest(rule->target, &digest) != 0
+        || digest != rule->restat_digest)
+    {
+        return;
     }
-    built_targets[built_count++] = string_duplicate(target);
+    rule->unchanged = 1; /*Same content*/
+    restat_record(rule, st.st_mtim.tv_sec, content);
 }
 
 /*Forward declarations for mutual recursion*/
@@ -132,14 +468,17 @@ static int is_up_to_date(rule_t *rule);
 /*Check if all dependencies are nothing-to-be-done or up-to-date*/
 static int check_deps_status(rule_t *rule)
 {
-    for (size_t i = 0; i < rule->dep_count; i++)
+    size_t count;
+    const size_t *deps = graph_deps(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
     {
-        char *dep = variable_expand(rule->dependencies[i]);
-        rule_t *dep_rule = rule_find(dep);
+        rule_t *dep_rule = graph_rule(deps[i]);
         /*Check if dependency is nothing-to-be-done or up-to-date*/
-        int ntbd = dep_rule ? is_nothing_done(dep_rule) : 0;
-        int utd = dep_rule ? is_up_to_date(dep_rule) : file_exists(dep);
-        free(dep);
+        /*(a restat-unchanged output does not make its dependents stale)*/
+        int ntbd = dep_rule ? dep_rule->unchanged || is_nothing_done(dep_rule)
+                            : 0;
+        int utd = dep_rule ? is_up_to_date(dep_rule)
+                           : file_exists(graph_name(deps[i]));
         if (!ntbd && !utd)
         {
             return 0; /*At least one dep needs building*/
@@ -163,8 +502,8 @@ static int is_nothing_done(rule_t *rule)
 /*Check if rule is "up to date"*/
 static int is_up_to_date(rule_t *rule)
 {
-    /*Must have a recipe*/
-    if (rule->recipe_count == 0)
+    /*Must have a recipe, and a phony target is never up to date*/
+    if (rule->recipe_count == 0 || rule->is_phony)
     {
         return 0;
     }
@@ -179,147 +518,455 @@ static int is_up_to_date(rule_t *rule)
         return 0;
     }
     /*Target must be newer than all file dependencies*/
-    for (size_t i = 0; i < rule->dep_count; i++)
+    size_t count;
+    const size_t *deps = graph_deps(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
     {
-        char *dep = variable_expand(rule->dependencies[i]);
-        if (file_exists(dep) && is_older(rule->target, dep))
+        /*Phony dependencies are not files: they were settled above*/
+        rule_t *dep_rule = graph_rule(deps[i]);
+        if (dep_rule && dep_rule->is_phony)
+        {
+            continue;
+        }
+        const char *dep = graph_name(deps[i]);
+        if (file_exists(dep) && restat_older(rule->target, dep))
         {
-            free(dep);
             return 0; /*Dependency is newer*/
         }
-        free(dep);
     }
     return 1; /*Target is up to date*/
 }
 
+/*Print a progress message (-q prints nothing)*/
+static void report(const char *format, const char *target)
+{
+    if (run_mode != RUN_QUESTION)
+    {
+        printf(format, target);
+    }
+}
+
+/*Settle a rule and wake the waiting rules that depend on it*/
+static void settle(rule_t *rule, int state)
+{
+    rule->state = state;
+    size_t count;
+    const size_t *users = graph_dependents(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        rule_t *user = graph_rule(users[i]);
+        if (user->state == BUILD_WAITING && !user->woken)
+        {
+            user->woken = 1;
+            woken_count++;
+        }
+    }
+}
+
+/*Record the end of a recipe and give its job slot back*/
+static void finish_job(rule_t *rule, int status)
+{
+    settle(rule, status == 0 ? BUILD_DONE : BUILD_FAILED);
+    if (status != 0)
+    {
+        /*With -k, only the dependents of this rule are given up*/
+        build_failed = !keep_going;
+        rule_array_push(&failed, &failed_count, &failed_cap, rule);
+    }
+    else if (rule->restat != RESTAT_OFF)
+    {
+        restat_end(rule);
+    }
+    if (tokens_held > 0)
+    {
+        jobserver_release();
+        tokens_held--;
+    }
+}
+
+/*Collect finished recipes (a blocking call waits for at least one)*/
+static void reap_jobs(int block)
+{
+    int status = 0;
+    rule_t *done;
+    int phase = stats_phase(PHASE_EXEC);
+    while ((done = executor_wait(block, &status)))
+    {
+        finish_job(done, status);
+        block = 0;
+    }
+    stats_phase(phase);
+}
+
+/*Wait for a job slot: the first running job uses our implicit token*/
+static int acquire_slot(void)
+{
+    while (executor_running() > 0)
+    {
+        if (build_failed)
+        {
+            return 2;
+        }
+        /*Under load or memory pressure, wait for running jobs instead*/
+        if (!load_allows_job())
+        {
+            struct timespec pause = { 0, SLOT_POLL_MS * 1000000L };
+            nanosleep(&pause, NULL);
+            reap_jobs(0);
+            continue;
+        }
+        if (!jobserver_active())
+        {
+            return 0; /*Unlimited -j*/
+        }
+        if (jobserver_acquire(SLOT_POLL_MS))
+        {
+            tokens_held++;
+            return 0;
+        }
+        reap_jobs(0);
+    }
+    return build_failed ? 2 : 0;
+}
+
+/*Check dependency rules: 1 all settled, 0 some pending, -1 one failed*/
+static int deps_settled(rule_t *rule)
+{
+    int settled = 1;
+    size_t count;
+    const size_t *deps = graph_deps(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
+    {
+        rule_t *dep_rule = graph_rule(deps[i]);
+        if (!dep_rule)
+        {
+            continue;
+        }
+        if (dep_rule->state == BUILD_FAILED)
+        {
+            return -1;
+        }
+        /*A dependency still being visited is a dropped cycle*/
+        if (dep_rule->state != BUILD_DONE
+            && dep_rule->state != BUILD_VISITING)
+        {
+            settled = 0;
+        }
+    }
+    return settled;
+}
+
+/*Remember a rule until its running dependencies finish*/
+static void add_waiting(rule_t *rule)
+{
+    if (waiting_count >= waiting_cap)
+    {
+        waiting_cap = waiting_cap ? waiting_cap * 2 : 16;
+        waiting = realloc(waiting, sizeof(rule_t *) * waiting_cap);
+        if (!waiting)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    waiting[waiting_count++] = rule;
+    rule->state = BUILD_WAITING;
+}
+
+/*Decide what to do with a rule once its dependencies were visited*/
+static int schedule(rule_t *rule)
+{
+    int settled = deps_settled(rule);
+    if (settled < 0)
+    {
+        settle(rule, BUILD_FAILED);
+        return 2;
+    }
+    if (settled == 0)
+    {
+        add_waiting(rule);
+        return 0;
+    }
+    /*Check if nothing to be done*/
+    if (is_nothing_done(rule))
+    {
+        report("minimake: Nothing to be done for '%s'.\n", rule->target);
+        settle(rule, BUILD_DONE);
+        return 0;
+    }
+    /*Check if up to date*/
+    if (is_up_to_date(rule))
+    {
+        report("minimake: '%s' is up to date.\n", rule->target);
+        settle(rule, BUILD_DONE);
+        return 0;
+    }
+    /*-q stops at the first stale target, -n only shows its recipe*/
+    if (run_mode == RUN_QUESTION)
+    {
+        question_stale = 1;
+        settle(rule, BUILD_FAILED);
+        return 2;
+    }
+    if (run_mode == RUN_DRY)
+    {
+        executor_print(rule);
+        settle(rule, BUILD_DONE);
+        return 0;
+    }
+    /*Execute the recipe*/
+    if (acquire_slot() != 0)
+    {
+        settle(rule, BUILD_FAILED);
+        return 2;
+    }
+    rule->state = BUILD_RUNNING;
+    if (rule->restat != RESTAT_OFF)
+    {
+        restat_begin(rule);
+    }
+    int phase = stats_phase(PHASE_EXEC);
+    if (!parallel)
+    {
+        finish_job(rule, execute_recipe(rule));
+    }
+    else
+    {
+        load_job_started();
+        int ret = executor_start(rule);
+        if (ret != 0)
+        {
+            finish_job(rule, ret == 1 ? 0 : ret);
+        }
+    }
+    stats_phase(phase);
+    return rule->state == BUILD_FAILED ? 2 : 0;
+}
+
+/*Schedule waiting rules whose dependencies have now finished*/
+static int process_waiting(void)
+{
+    int ret = 0;
+    /*Only woken rules are re-checked; releasing one may wake others*/
+    while (woken_count > 0)
+    {
+        for (size_t i = 0; i < waiting_count && woken_count > 0;)
+        {
+            rule_t *rule = waiting[i];
+            if (!rule->woken)
+            {
+                i++;
+                continue;
+            }
+            rule->woken = 0;
+            woken_count--;
+            if (deps_settled(rule) == 0)
+            {
+                i++;
+                continue;
+            }
+            /*Keep the visiting order among released rules*/
+            waiting_count--;
+            memmove(&waiting[i], &waiting[i + 1],
+                    sizeof(rule_t *) * (waiting_count - i));
+            if (schedule(rule) != 0)
+            {
+                ret = 2;
+            }
+        }
+    }
+    return ret;
+}
+
+static int visit_rule(rule_t *rule, const char *parent);
+
 /*Build all dependencies of a rule*/
 static int build_dependencies(rule_t *rule)
 {
-    for (size_t i = 0; i < rule->dep_count; i++)
+    int failures = 0;
+    size_t count;
+    const size_t *deps = graph_deps(rule->id, &count);
+    for (size_t i = 0; i < count; i++)
     {
-        char *dep = variable_expand(rule->dependencies[i]);
         /*Check if dependency rule exists or file exists*/
-        rule_t *dep_rule = rule_find(dep);
-        if (!dep_rule && !file_exists(dep))
+        rule_t *dep_rule = graph_rule(deps[i]);
+        if (!dep_rule && !file_exists(graph_name(deps[i])))
         {
             char msg[512];
             snprintf(msg, sizeof(msg),
-                     "No rule to make target '%s', needed by '%s'", dep,
-                     rule->target);
+                     "No rule to make target '%s', needed by '%s'",
+                     graph_name(deps[i]), rule->target);
             error_exit(msg);
-            free(dep);
             return 2;
         }
         /*Recursively build dependency*/
         if (dep_rule)
         {
-            int ret = build_target(dep);
-            if (ret != 0)
+            int ret = visit_rule(dep_rule, rule->target);
+            if (ret == 0)
+            {
+                ret = process_waiting();
+            }
+            if (ret != 0 && !keep_going)
             {
-                free(dep);
                 return ret;
             }
+            failures |= ret;
         }
-        free(dep);
     }
-    return 0;
+    return failures ? 2 : 0;
 }
 
-/*Build a target (main build logic)*/
-int build_target(const char *target)
+/*Report a target reached again during this run*/
+static int revisit(rule_t *rule, const char *parent)
 {
-    char *exp_target = variable_expand(target);
-    /*Check if already built (deduplication)*/
-    if (was_built(exp_target))
+    if (rule->state == BUILD_DONE)
     {
-        rule_t *r = rule_find(exp_target);
-        if (r && r->is_phony)
+        if (rule->is_phony)
         {
-            printf("minimake: Nothing to be done for '%s'.\n", exp_target);
+            report("minimake: Nothing to be done for '%s'.\n", rule->target);
         }
         else
         {
-            printf("minimake: '%s' is up to date.\n", exp_target);
+            report("minimake: '%s' is up to date.\n", rule->target);
         }
-        free(exp_target);
         return 0;
     }
-    /*Find the rule*/
-    rule_t *rule = rule_find(exp_target);
-    if (!rule)
+    if (rule->state == BUILD_VISITING && parent)
     {
-        char msg[256];
-        snprintf(msg, sizeof(msg), "No rule to make target '%s'", exp_target);
-        error_exit(msg);
-        free(exp_target);
-        return 2;
+        char msg[512];
+        snprintf(msg, sizeof(msg), "Circular %s <- %s dependency dropped.",
+                 parent, rule->target);
+        error_msg(msg);
+    }
+    return rule->state == BUILD_FAILED ? 2 : 0;
+}
+
+/*Visit a rule: build its dependencies, then schedule its recipe*/
+static int visit_rule(rule_t *rule, const char *parent)
+{
+    /*Check if already reached (deduplication)*/
+    if (rule->state != BUILD_NONE)
+    {
+        return revisit(rule, parent);
     }
     /*Check if target is phony*/
-    rule->is_phony = is_phony_target(exp_target);
+    rule->is_phony = rule_is_phony(rule->target);
+    rule->restat =
+        rule->is_phony ? RESTAT_OFF : restat_target_mode(rule->target);
     /*Build all dependencies first*/
+    rule->state = BUILD_VISITING;
     if (build_dependencies(rule) != 0)
     {
-        free(exp_target);
+        settle(rule, BUILD_FAILED);
         return 2;
     }
-    /*Mark as built for deduplication*/
-    mark_built(exp_target);
-    /*Check if nothing to be done*/
-    if (is_nothing_done(rule))
+    return schedule(rule);
+}
+
+/*Report the recipes that failed, then the goal given up because of them*/
+static void report_failures(rule_t *goal)
+{
+    char msg[512];
+    for (; failed_reported < failed_count; failed_reported++)
     {
-        printf("minimake: Nothing to be done for '%s'.\n", exp_target);
-        free(exp_target);
-        return 0;
+        snprintf(msg, sizeof(msg), "*** [%s] Error",
+                 failed[failed_reported]->target);
+        error_msg(msg);
     }
-    /*Check if up to date*/
-    if (is_up_to_date(rule))
+    snprintf(msg, sizeof(msg), "Target '%s' not remade because of errors.",
+             goal->target);
+    error_msg(msg);
+}
+
+/*Build a target (main build logic)*/
+int build_target(const char *target)
+{
+    char *exp_target = variable_expand(target);
+    /*Find the rule*/
+    rule_t *rule = rule_find(exp_target);
+    if (!rule)
     {
-        printf("minimake: '%s' is up to date.\n", exp_target);
+        char msg[256];
+        snprintf(msg, sizeof(msg), "No rule to make target '%s'", exp_target);
+        error_exit(msg);
         free(exp_target);
-        return 0;
+        return 2;
     }
-    /*Execute the recipe*/
-    int ret = execute_recipe(rule);
     free(exp_target);
-    return ret;
-}
-
-/*Free all rules and cleanup*/
-void rules_free(void)
-{
-    /*Free regular rules*/
-    while (rules_head)
+    int ret = visit_rule(rule, NULL);
+    /*Drive running recipes until the goal is settled*/
+    while (ret == 0 && rule
+           && (rule->state == BUILD_WAITING || rule->state == BUILD_RUNNING))
     {
-        rule_t *tmp = rules_head;
-        rules_head = rules_head->next;
-        free(tmp->target);
-        for (size_t i = 0; i < tmp->dep_count; i++)
+        ret = process_waiting();
+        if (rule->state != BUILD_WAITING && rule->state != BUILD_RUNNING)
         {
-            free(tmp->dependencies[i]);
+            break;
         }
-        free(tmp->dependencies);
-        for (size_t i = 0; i < tmp->recipe_count; i++)
+        if (executor_running() == 0)
         {
-            free(tmp->recipe[i]);
+            break;
         }
-        free(tmp->recipe);
-        free(tmp);
+        reap_jobs(1);
+    }
+    if (rule && rule->state == BUILD_FAILED)
+    {
+        ret = 2;
     }
-    /*Free .PHONY rule*/
-    if (phony_rule)
+    /*Let running recipes finish before reporting a failure*/
+    if (executor_running() > 0)
     {
-        free(phony_rule->target);
-        for (size_t i = 0; i < phony_rule->dep_count; i++)
+        if (ret != 0 && !keep_going)
         {
-            free(phony_rule->dependencies[i]);
+            error_msg("*** Waiting for unfinished jobs....");
         }
-        free(phony_rule->dependencies);
-        free(phony_rule);
+        while (executor_running() > 0)
+        {
+            reap_jobs(1);
+            /*With -k, rules unrelated to the failure still get to run*/
+            if (keep_going)
+            {
+                process_waiting();
+            }
+        }
+    }
+    if (ret != 0 && question_stale)
+    {
+        return 1; /*-q: not up to date*/
+    }
+    if (ret != 0 && keep_going)
+    {
+        report_failures(rule);
     }
-    /*Free built targets list*/
-    for (size_t i = 0; i < built_count; i++)
+    return ret;
+}
+
+/*Free a rule (its names belong to the intern table)*/
+static void rule_destroy(rule_t *rule)
+{
+    free(rule->dependencies);
+    for (size_t i = 0; i < rule->recipe_count; i++)
+    {
+        free(rule->recipe[i]);
+    }
+    free(rule->recipe);
+    free(rule);
+}
+
+/*Free all rules and cleanup*/
+void rules_free(void)
+{
+    /*Free every rule, special ones included*/
+    for (size_t i = 0; i < rule_count; i++)
     {
-        free(built_targets[i]);
+        rule_destroy(rules[i]);
     }
-    free(built_targets);
+    free(rules);
+    free(restat_rules);
+    free(restat_log);
+    free(failed);
+    free(phony_set);
+    graph_free();
+    /*Free scheduler state*/
+    free(waiting);
 }
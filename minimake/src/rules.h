@@ -2,23 +2,65 @@
 #define RULES_H
 
 #include <stddef.h>
+#include <time.h>
 
 typedef struct rule {
-    char *target;
-    char **dependencies;
+    size_t id; /*Graph ID of the target*/
+    const char *target; /*Interned name*/
+    const char **dependencies; /*Interned names*/
     size_t dep_count;
     char **recipe;
     size_t recipe_count;
     int is_pattern;
     int is_phony;
-    struct rule *next;
+    int state; /*Scheduling state during a build*/
+    int woken; /*A dependency settled while the rule was waiting*/
+    int restat; /*Re-check the output after the recipe (restat mode)*/
+    int unchanged; /*The recipe ran but left the output unchanged*/
+    int restat_existed; /*The output existed before the recipe*/
+    time_t restat_sec; /*Output mtime before the recipe*/
+    long restat_nsec;
+    unsigned long long restat_digest; /*Output content before the recipe*/
 } rule_t;
 
+/*Scheduling states of a rule during a build*/
+enum build_state
+{
+    BUILD_NONE = 0,
+    BUILD_VISITING,
+    BUILD_WAITING,
+    BUILD_RUNNING,
+    BUILD_DONE,
+    BUILD_FAILED
+};
+
+/*Run modes: build, or only answer whether targets are up to date*/
+enum run_mode
+{
+    RUN_BUILD = 0,
+    RUN_QUESTION, /*-q: execute nothing, exit 1 if a target is stale*/
+    RUN_DRY /*-n: print the recipes that would run*/
+};
+
+/*Restat modes: how outputs are re-checked after their recipe*/
+enum restat_mode
+{
+    RESTAT_OFF = 0,
+    RESTAT_MTIME,
+    RESTAT_DIGEST
+};
+
 void rules_init(void);
+void rules_set_restat(int mode);
+void rules_set_parallel(int enable);
+void rules_set_run_mode(int mode);
+void rules_set_keep_going(int enable);
 rule_t *rule_create(const char *target);
 void rule_add(rule_t *rule);
 rule_t *rule_find(const char *target);
 rule_t *rule_get_default(void);
+rule_t **rules_all(size_t *count);
+int rule_is_phony(const char *target);
 int build_target(const char *target);
 void rules_free(void);
 
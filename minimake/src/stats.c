@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+stats_t stats;
+
+/*Time spent in each phase, in seconds*/
+static double phase_time[PHASE_COUNT];
+static int current_phase = PHASE_NONE;
+static struct timespec phase_start;
+static int enabled = 0;
+static int report_json = 0;
+
+/*Names of the phases, for the report*/
+static const char *phase_names[PHASE_COUNT] = { "other", "parse",
+                                                "graph evaluation",
+                                                "execution" };
+
+/*Switch to another phase, return the previous one*/
+int stats_phase(int phase)
+{
+    int previous = current_phase;
+    current_phase = phase;
+    if (!enabled)
+    {
+        return previous;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    phase_time[previous] += (now.tv_sec - phase_start.tv_sec)
+        + (now.tv_nsec - phase_start.tv_nsec) / 1e9;
+    phase_start = now;
+    return previous;
+}
+
+/*Print the report at exit, as a table or as JSON*/
+void stats_enable(int json)
+{
+    enabled = 1;
+    report_json = json;
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    atexit(stats_report);
+}
+
+/*Print all counters to stderr*/
+void stats_report(void)
+{
+    stats_phase(PHASE_NONE);
+    struct rusage usage;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    unsigned long heap_bytes = 0;
+    unsigned long heap_in_use = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    heap_bytes = mi.arena + mi.hblkhd;
+    heap_in_use = mi.uordblks + mi.hblkhd;
+#endif
+    const struct {
+        const char *key;
+        const char *label;
+        unsigned long value;
+    } counters[] = {
+        { "stat_calls", "stat/access calls", stats.stat_calls },
+        { "dir_scans", "directory scans", stats.dir_scans },
+        { "expand_calls", "variable_expand calls", stats.expand_calls },
+        { "expand_bytes", "variable_expand bytes", stats.expand_bytes },
+        { "rule_lookups", "rule_find calls", stats.rule_lookups },
+        { "forks", "forks", stats.forks },
+        { "execs", "execs", stats.execs },
+        { "builtins", "in-process commands", stats.builtins },
+        { "heap_bytes", "heap bytes allocated", heap_bytes },
+        { "heap_in_use", "heap bytes in use", heap_in_use },
+        { "peak_rss_kb", "peak RSS (kB)", (unsigned long)peak_rss_kb },
+    };
+    size_t count = sizeof(counters) / sizeof(*counters);
+    if (report_json)
+    {
+        fprintf(stderr, "{");
+        for (size_t i = 0; i < count; i++)
+        {
+            fprintf(stderr, "\"%s\": %lu, ", counters[i].key,
+                    counters[i].value);
+        }
+        fprintf(stderr, "\"parse_ms\": %.3f, \"eval_ms\": %.3f, "
+                "\"exec_ms\": %.3f}\n", phase_time[PHASE_PARSE] * 1000,
+                phase_time[PHASE_EVAL] * 1000, phase_time[PHASE_EXEC] * 1000);
+        return;
+    }
+    fprintf(stderr, "minimake statistics:\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(stderr, "  %-24s %12lu\n", counters[i].label,
+                counters[i].value);
+    }
+    for (int p = PHASE_PARSE; p < PHASE_COUNT; p++)
+    {
+        fprintf(stderr, "  %-24s %9.3f ms\n", phase_names[p],
+                phase_time[p] * 1000);
+    }
+}
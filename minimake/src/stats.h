@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*Phases of a run, timed separately*/
+enum stats_phase
+{
+    PHASE_NONE = 0,
+    PHASE_PARSE,
+    PHASE_EVAL,
+    PHASE_EXEC,
+    PHASE_COUNT
+};
+
+/*Execution counters, always compiled in (plain increments)*/
+typedef struct stats {
+    unsigned long stat_calls; /*stat/access probes of the filesystem*/
+    unsigned long dir_scans; /*Directories read for $(wildcard)*/
+    unsigned long expand_calls; /*variable_expand() calls*/
+    unsigned long expand_bytes; /*Bytes produced by variable_expand()*/
+    unsigned long rule_lookups; /*rule_find() calls*/
+    unsigned long forks; /*Child processes created*/
+    unsigned long execs; /*Shells executed (recipes and $(shell))*/
+    unsigned long builtins; /*Recipe lines run in-process*/
+} stats_t;
+
+extern stats_t stats;
+
+#define STATS_INC(field) (stats.field++)
+#define STATS_ADD(field, n) (stats.field += (n))
+
+int stats_phase(int phase);
+void stats_enable(int json);
+void stats_report(void);
+
+#endif /*STATS_H*/
@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /*syscall(), for pidfd_open*/
+
+#include "supervisor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+/*Seconds between SIGTERM and SIGKILL for a cancelled command*/
+#define KILL_GRACE 2.0
+
+/*Longest sleep while some child has no pidfd and must be polled (ms)*/
+#define POLL_FALLBACK_MS 50
+
+/*Events handled per epoll_wait call*/
+#define MAX_EVENTS 64
+
+/*A running command*/
+typedef struct child {
+    pid_t pid;
+    int pidfd; /*-1: found by SIGCHLD or by polling*/
+    double deadline; /*0: no timeout*/
+    double kill_at; /*After a cancel: when to send SIGKILL*/
+    int timed_out;
+    supervisor_done_t done;
+    void *data;
+} child_t;
+
+static int initialized = 0;
+static int epoll_fd = -1;
+static int use_pidfd = 0;
+static int signal_fd = -1; /*SIGCHLD, when pidfds are unavailable*/
+static int wake_pipe[2] = { -1, -1 }; /*Written by the signal handler*/
+static sigset_t saved_mask; /*Restored in children*/
+static volatile sig_atomic_t pending_signal = 0;
+static int tty_fd = -1; /*Our terminal, when we started in its foreground*/
+static pid_t tty_owner = 0; /*Command whose group holds the terminal*/
+
+static child_t **children = NULL;
+static size_t child_count = 0;
+static size_t child_cap = 0;
+
+/*Tags of the non-child epoll sources*/
+static char wake_tag;
+static char signal_tag;
+
+/*Fatal signals that stop the build*/
+static const int fatal_signals[] = { SIGINT, SIGTERM, SIGHUP };
+#define FATAL_SIGNAL_COUNT (sizeof(fatal_signals) / sizeof(fatal_signals[0]))
+
+/*Current monotonic time in seconds*/
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*Make a process group the terminal's foreground group; SIGTTOU is held
+  off because the caller may be in a background group by then*/
+static void tty_give(pid_t pgid)
+{
+    sigset_t ttou;
+    sigset_t old;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &ttou, &old);
+    tcsetpgrp(tty_fd, pgid);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+/*Open a pidfd, or -1 where the kernel lacks pidfd_open*/
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*Remember a fatal signal and wake the event loop*/
+static void on_fatal_signal(int sig)
+{
+    int saved_errno = errno;
+    pending_signal = sig;
+    if (write(wake_pipe[1], "!", 1) < 0)
+    {
+        /*The pipe is full: a wakeup is already pending*/
+    }
+    errno = saved_errno;
+}
+
+/*Whether a fatal signal is ours to handle (not ignored since startup)*/
+static int interruptible(int sig)
+{
+    struct sigaction sa;
+    sigaction(sig, NULL, &sa);
+    return sa.sa_handler == on_fatal_signal;
+}
+
+/*Watch a file descriptor for input*/
+static void watch(int fd, void *tag)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        error_exit("cannot watch child processes");
+    }
+}
+
+/*Set up epoll, the pidfd or SIGCHLD source, and the signal handlers*/
+static void supervisor_init(void)
+{
+    initialized = 1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0 || pipe(wake_pipe) != 0)
+    {
+        error_exit("cannot create the process supervisor");
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+    watch(wake_pipe[0], &wake_tag);
+    sigprocmask(SIG_SETMASK, NULL, &saved_mask);
+    if (isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp())
+    {
+        tty_fd = STDIN_FILENO;
+    }
+    /*pidfds need Linux 5.3; MINIMAKE_NO_PIDFD forces the fallback*/
+    int probe = getenv("MINIMAKE_NO_PIDFD") ? -1 : open_pidfd(getpid());
+    use_pidfd = probe >= 0;
+    if (use_pidfd)
+    {
+        close(probe);
+    }
+    else
+    {
+        sigset_t chld;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, NULL);
+        signal_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0)
+        {
+            error_exit("cannot watch child processes");
+        }
+        watch(signal_fd, &signal_tag);
+    }
+    /*Signals ignored at startup (nohup) stay ignored*/
+    for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++)
+    {
+        struct sigaction old;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_fatal_signal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(fatal_signals[i], NULL, &old);
+        if (old.sa_handler != SIG_IGN)
+        {
+            sigaction(fatal_signals[i], &sa, NULL);
+        }
+    }
+}
+
+/*Start a command with /bin/sh -c; done is called when it exits*/
+pid_t supervisor_launch(const char *cmd, char **envp, double timeout,
+                        supervisor_done_t done, void *data)
+{
+    if (!initialized)
+    {
+        supervisor_init();
+    }
+    /*A command gets its own process group, so that a cancel reaches the
+      whole command. A background group reading the tty would be stopped
+      by SIGTTIN, so one command at a time is handed the terminal*/
+    int take_tty = tty_fd >= 0 && tty_owner == 0;
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        error_msg("Fork failed");
+        return -1;
+    }
+    /*Child process: execute command with the original signal mask*/
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        if (take_tty)
+        {
+            tty_give(getpid()); /*Before exec: it may read at once*/
+        }
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+        execle("/bin/sh", "sh", "-c", cmd, (char *)NULL, envp);
+        perror("execle");
+        _exit(127);
+    }
+    setpgid(pid, pid); /*Also here: whichever runs first wins the race*/
+    if (take_tty)
+    {
+        tty_give(pid);
+        tty_owner = pid;
+    }
+    child_t *c = calloc(1, sizeof(child_t));
+    if (!c)
+    {
+        error_exit("Memory allocation failed");
+    }
+    c->pid = pid;
+    c->pidfd = use_pidfd ? open_pidfd(pid) : -1;
+    c->deadline = timeout > 0 ? now() + timeout : 0;
+    c->done = done;
+    c->data = data;
+    if (c->pidfd >= 0)
+    {
+        fcntl(c->pidfd, F_SETFD, FD_CLOEXEC);
+        watch(c->pidfd, c);
+    }
+    if (child_count >= child_cap)
+    {
+        child_cap = child_cap ? child_cap * 2 : 16;
+        children = realloc(children, sizeof(child_t *) * child_cap);
+        if (!children)
+        {
+            error_exit("Memory allocation failed");
+        }
+    }
+    children[child_count++] = c;
+    return pid;
+}
+
+/*Send SIGTERM to a command, then SIGKILL if it does not exit*/
+void supervisor_cancel(pid_t pid)
+{
+    for (size_t i = 0; i < child_count; i++)
+    {
+        if (children[i]->pid == pid && children[i]->kill_at == 0)
+        {
+            kill(-pid, SIGTERM);
+            children[i]->kill_at = now() + KILL_GRACE;
+        }
+    }
+}
+
+/*Number of commands still running*/
+size_t supervisor_running(void)
+{
+    return child_count;
+}
+
+/*Forget a child (its done callback is the caller's business)*/
+static void child_remove(size_t index)
+{
+    child_t *c = children[index];
+    if (c->pid == tty_owner)
+    {
+        tty_give(getpgrp());
+        tty_owner = 0;
+    }
+    if (c->pidfd >= 0)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->pidfd, NULL);
+        close(c->pidfd);
+    }
+    free(c);
+    children[index] = children[--child_count];
+}
+
+/*Reap a child if it exited, running its callback; 1 if it was reaped*/
+static int child_reap(size_t index)
+{
+    child_t *c = children[index];
+    int wstatus;
+    pid_t r = waitpid(c->pid, &wstatus, WNOHANG);
+    if (r == 0 || (r < 0 && errno == EINTR))
+    {
+        return 0;
+    }
+    if (r < 0)
+    {
+        wstatus = 127 << 8; /*Reaped by someone else: count as failed*/
+    }
+    pid_t pid = c->pid;
+    int timed_out = c->timed_out;
+    /*A Ctrl-C went to the command holding the terminal, not to us*/
+    if (pid == tty_owner && WIFSIGNALED(wstatus)
+        && WTERMSIG(wstatus) == SIGINT && interruptible(SIGINT))
+    {
+        pending_signal = SIGINT;
+    }
+    supervisor_done_t done = c->done;
+    void *data = c->data;
+    child_remove(index);
+    done(pid, wstatus, timed_out, data);
+    return 1;
+}
+
+/*Enforce deadlines; return the milliseconds until the next one (-1 none)*/
+static int check_deadlines(void)
+{
+    double t = now();
+    double next = -1;
+    for (size_t i = 0; i < child_count; i++)
+    {
+        child_t *c = children[i];
+        if (c->deadline > 0 && !c->timed_out && t >= c->deadline)
+        {
+            c->timed_out = 1;
+            supervisor_cancel(c->pid);
+        }
+        if (c->kill_at > 0 && t >= c->kill_at)
+        {
+            kill(-c->pid, SIGKILL);
+            c->kill_at = -1; /*Sent*/
+        }
+        double when = c->kill_at > 0 ? c->kill_at
+                      : c->deadline > 0 && !c->timed_out ? c->deadline
+                                                         : -1;
+        if (when > 0 && (next < 0 || when < next))
+        {
+            next = when;
+        }
+    }
+    return next < 0 ? -1 : (int)((next - t) * 1000) + 1;
+}
+
+/*Combine two epoll timeouts (-1 is infinite)*/
+static int min_timeout(int a, int b)
+{
+    if (a < 0)
+    {
+        return b;
+    }
+    return b < 0 || a < b ? a : b;
+}
+
+/*Wait up to timeout_ms (-1: forever) for exits; return how many, -1 if
+  a fatal signal arrived*/
+int supervisor_poll(int timeout_ms)
+{
+    if (!initialized)
+    {
+        return pending_signal ? -1 : 0;
+    }
+    int reaped = 0;
+    int wait_ms = min_timeout(timeout_ms, check_deadlines());
+    for (size_t i = 0; i < child_count && wait_ms != 0; i++)
+    {
+        if (children[i]->pidfd < 0 && signal_fd < 0)
+        {
+            wait_ms = min_timeout(wait_ms, POLL_FALLBACK_MS);
+        }
+    }
+    if (pending_signal)
+    {
+        return -1;
+    }
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, wait_ms);
+    int scan_all = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.ptr == &wake_tag)
+        {
+            char buf[64];
+            while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+            {
+                continue;
+            }
+        }
+        else if (events[i].data.ptr == &signal_tag)
+        {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) > 0)
+            {
+                continue;
+            }
+            scan_all = 1; /*SIGCHLD does not say which child*/
+        }
+        else
+        {
+            for (size_t j = 0; j < child_count; j++)
+            {
+                if (children[j] == events[i].data.ptr)
+                {
+                    reaped += child_reap(j);
+                    break;
+                }
+            }
+        }
+    }
+    /*Children without a pidfd are found by SIGCHLD or by polling*/
+    for (size_t j = 0; j < child_count;)
+    {
+        if (children[j]->pidfd < 0 || scan_all)
+        {
+            int r = child_reap(j);
+            reaped += r;
+            j += !r;
+        }
+        else
+        {
+            j++;
+        }
+    }
+    check_deadlines();
+    return pending_signal ? -1 : reaped;
+}
+
+/*Fatal signal received since the supervisor started, or 0*/
+int supervisor_interrupted(void)
+{
+    return pending_signal;
+}
+
+/*Pass a fatal signal on to every command and wait for all of them*/
+void supervisor_terminate(int sig)
+{
+    /*Commands in their own groups did not see a Ctrl-C: pass it on*/
+    for (size_t i = 0; i < child_count; i++)
+    {
+        kill(-children[i]->pid, sig);
+        children[i]->kill_at = now() + KILL_GRACE;
+    }
+    while (child_count > 0)
+    {
+        for (size_t i = 0; i < child_count;)
+        {
+            child_t *c = children[i];
+            int wstatus;
+            pid_t r = waitpid(c->pid, &wstatus, WNOHANG);
+            if (r != 0 && !(r < 0 && errno == EINTR))
+            {
+                child_remove(i);
+                continue;
+            }
+            if (c->kill_at > 0 && now() >= c->kill_at)
+            {
+                kill(-c->pid, SIGKILL);
+                c->kill_at = -1;
+            }
+            i++;
+        }
+        struct timespec pause = { 0, 10000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+/*Die from a fatal signal, so that our parent sees how we ended*/
+void supervisor_reraise(int sig)
+{
+    signal(sig, SIG_DFL);
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    raise(sig);
+    exit(128 + sig);
+}
+
+/*Release the supervisor (running commands are left alone)*/
+void supervisor_free(void)
+{
+    while (child_count > 0)
+    {
+        child_remove(0);
+    }
+    free(children);
+    children = NULL;
+    child_cap = 0;
+    if (initialized)
+    {
+        close(epoll_fd);
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        if (signal_fd >= 0)
+        {
+            close(signal_fd);
+        }
+    }
+    epoll_fd = -1;
+    signal_fd = -1;
+    wake_pipe[0] = -1;
+    wake_pipe[1] = -1;
+    initialized = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <sys/types.h>
+
+/*Called once a launched command has exited (wstatus as from waitpid)*/
+typedef void (*supervisor_done_t)(pid_t pid, int wstatus, int timed_out,
+                                  void *data);
+
+pid_t supervisor_launch(const char *cmd, char **envp, double timeout,
+                        supervisor_done_t done, void *data);
+void supervisor_cancel(pid_t pid);
+size_t supervisor_running(void);
+int supervisor_poll(int timeout_ms);
+int supervisor_interrupted(void);
+void supervisor_terminate(int sig);
+void supervisor_reraise(int sig);
+void supervisor_free(void);
+
+#endif /*SUPERVISOR_H*/
@@ -1,12 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "utils.h"
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "intern.h"
+#include "stats.h"
+
 /*Print error message to stderr and exit with code 2*/
 void error_exit(const char *msg)
 {
@@ -20,16 +26,85 @@ void error_msg(const char *msg)
     fprintf(stderr, "minimake: %s\n", msg);
 }
 
+/* Cached stat result of one path */
+typedef struct stat_entry {
+    char known; /* The path was stat'ed */
+    char exists;
+    time_t mtime;
+} stat_entry_t;
+
+/* Stat results by interned path ID, when files cannot change (-q, -n) */
+static int stat_cache_on = 0;
+static stat_entry_t *stat_cache = NULL;
+static size_t stat_cache_cap = 0;
+
+/* Remember stat results for the rest of the run */
+void stat_cache_enable(void)
+{
+    stat_cache_on = 1;
+}
+
+/* Free the stat cache */
+void stat_cache_free(void)
+{
+    free(stat_cache);
+    stat_cache = NULL;
+    stat_cache_cap = 0;
+    stat_cache_on = 0;
+}
+
+/* Stat a path once, then answer from the cache */
+static stat_entry_t *stat_cached(const char *path)
+{
+    size_t id = intern(path);
+    if (id >= stat_cache_cap)
+    {
+        size_t cap = stat_cache_cap ? stat_cache_cap : 256;
+        while (cap <= id)
+        {
+            cap *= 2;
+        }
+        stat_cache = realloc(stat_cache, sizeof(stat_entry_t) * cap);
+        if (!stat_cache)
+        {
+            error_exit("Memory allocation failed");
+        }
+        memset(stat_cache + stat_cache_cap, 0,
+               sizeof(stat_entry_t) * (cap - stat_cache_cap));
+        stat_cache_cap = cap;
+    }
+    stat_entry_t *e = &stat_cache[id];
+    if (!e->known)
+    {
+        struct stat st;
+        STATS_INC(stat_calls);
+        e->known = 1;
+        e->exists = stat(path, &st) == 0;
+        e->mtime = e->exists ? st.st_mtime : 0;
+    }
+    return e;
+}
+
 /* Check if a file exists using access() */
 int file_exists(const char *path)
 {
+    if (stat_cache_on)
+    {
+        return stat_cached(path)->exists;
+    }
+    STATS_INC(stat_calls);
     return access(path, F_OK) == 0;
 }
 
 /* Get file modification time using stat() */
 time_t get_modification_time(const char *path)
 {
+    if (stat_cache_on)
+    {
+        return stat_cached(path)->mtime;
+    }
     struct stat st;
+    STATS_INC(stat_calls);
     if (stat(path, &st) != 0)
     {
         return 0;
@@ -49,6 +124,33 @@ int is_older(const char *file1, const char *file2)
     return t1 < t2;
 }
 
+/* Hash the contents of a file (64-bit FNV-1a), 0 on success */
+int file_digest(const char *path, unsigned long long *digest)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    unsigned long long h = 14695981039346656037ULL;
+    unsigned char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < n; i++)
+        {
+            h = (h ^ buf[i]) * 1099511628211ULL;
+        }
+    }
+    close(fd);
+    if (n < 0)
+    {
+        return -1;
+    }
+    *digest = h;
+    return 0;
+}
+
 /* Duplicate a string with error checking */
 char *string_duplicate(const char *str)
 {
@@ -6,9 +6,12 @@
 
 void error_exit(const char *msg);
 void error_msg(const char *msg);
+void stat_cache_enable(void);
+void stat_cache_free(void);
 int file_exists(const char *path);
 time_t get_modification_time(const char *path);
 int is_older(const char *file1, const char *file2);
+int file_digest(const char *path, unsigned long long *digest);
 char *string_duplicate(const char *str);
 char **split_whitespace(const char *str, size_t *count);
 void free_string_array(char **arr);
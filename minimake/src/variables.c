@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "variables.h"
 
 #include <ctype.h>
@@ -5,100 +7,301 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "functions.h"
+#include "intern.h"
+#include "stats.h"
 #include "utils.h"
 
 /*Head of the variables linked list*/
 static variable_t *vars_head = NULL;
 
+/*Variable of each interned name, indexed by string ID*/
+static variable_t **by_name = NULL;
+static size_t by_name_cap = 0;
+
+/*Bumped on every assignment: memos of older generations are stale*/
+static unsigned long generation = 0;
+
+/*Exported variables: flag by string ID, or all of them (bare export)*/
+static unsigned char *export_set = NULL;
+static size_t export_cap = 0;
+static int export_all = 0;
+static int export_any = 0;
+
+/*Environment handed to recipes, rebuilt only after a change*/
+extern char **environ;
+static char **env_cache = NULL;
+static char **env_owned = NULL; /*NAME=value strings we allocated*/
+static size_t env_owned_count = 0;
+static int env_dirty = 1;
+
 /*Initialize the variable system (reset to empty)*/
 void variable_init(void)
 {
     vars_head = NULL;
+    by_name = NULL;
+    by_name_cap = 0;
+    generation = 0;
+    export_set = NULL;
+    export_cap = 0;
+    export_all = 0;
+    export_any = 0;
+    env_cache = NULL;
+    env_owned = NULL;
+    env_owned_count = 0;
+    env_dirty = 1;
 }
 
-/*Set a variable value (creates new or updates existing)*/
-void variable_set(const char *name, const char *value)
+/*Find a variable by its (expanded) name*/
+static variable_t *variable_find(const char *name)
 {
-    /*Expand variable name (for cases like $(VAR)=value)*/
-    char *exp_name = variable_expand(name);
-    /*Check if variable already exists*/
-    for (variable_t *v = vars_head; v; v = v->next)
+    /*A name never interned cannot be defined*/
+    size_t id = intern_find(name);
+    return id < by_name_cap ? by_name[id] : NULL;
+}
+
+/*Store a value and flavor (creates new or updates existing)*/
+static void variable_store(char *exp_name, char *value, int flavor)
+{
+    generation++;
+    /*A recursive exported value may refer to any variable*/
+    env_dirty = 1;
+    size_t id = intern(exp_name);
+    free(exp_name);
+    if (id >= by_name_cap)
     {
-        if (strcmp(v->name, exp_name) == 0)
+        size_t cap = by_name_cap ? by_name_cap : 64;
+        while (cap <= id)
+        {
+            cap *= 2;
+        }
+        by_name = realloc(by_name, sizeof(variable_t *) * cap);
+        if (!by_name)
         {
-            /*Update existing variable*/
-            free(v->value);
-            v->value = string_duplicate(value);
-            free(exp_name);
-            return;
+            error_exit("Memory allocation failed");
         }
+        memset(by_name + by_name_cap, 0,
+               sizeof(variable_t *) * (cap - by_name_cap));
+        by_name_cap = cap;
+    }
+    variable_t *v = by_name[id];
+    if (v)
+    {
+        /*Update existing variable*/
+        free(v->value);
+        v->value = value;
+        v->flavor = flavor;
+        return;
     }
     /*Create new variable*/
-    variable_t *new_var = malloc(sizeof(variable_t));
-    if (!new_var)
+    v = calloc(1, sizeof(variable_t));
+    if (!v)
     {
         error_exit("Memory allocation failed");
     }
-    new_var->name = exp_name;
-    new_var->value = string_duplicate(value);
-    new_var->next = vars_head;
-    vars_head = new_var;
+    v->name = intern_name(id);
+    v->value = value;
+    v->flavor = flavor;
+    v->next = vars_head;
+    vars_head = v;
+    by_name[id] = v;
+}
+
+/*Assign with a make operator: =, :=, ::=, ?= or +=*/
+void variable_assign(const char *name, const char *op, const char *value)
+{
+    /*Expand variable name (for cases like $(VAR)=value)*/
+    char *exp_name = variable_expand(name);
+    variable_t *v = variable_find(exp_name);
+    if (strcmp(op, "?=") == 0 && (v || getenv(exp_name)))
+    {
+        free(exp_name); /*Already defined*/
+        return;
+    }
+    if (strcmp(op, ":=") == 0 || strcmp(op, "::=") == 0)
+    {
+        /*Simple variable: expanded once, here*/
+        variable_store(exp_name, variable_expand(value), VAR_SIMPLE);
+        return;
+    }
+    if (strcmp(op, "+=") == 0 && v)
+    {
+        /*Append in the flavor of the existing variable*/
+        char *add = v->flavor == VAR_SIMPLE ? variable_expand(value)
+                                            : string_duplicate(value);
+        char *joined = malloc(strlen(v->value) + strlen(add) + 2);
+        if (!joined)
+        {
+            error_exit("Memory allocation failed");
+        }
+        sprintf(joined, "%s%s%s", v->value, *v->value ? " " : "", add);
+        free(add);
+        variable_store(exp_name, joined, v->flavor);
+        return;
+    }
+    variable_store(exp_name, string_duplicate(value), VAR_RECURSIVE);
+}
+
+/*Set a recursive variable value (creates new or updates existing)*/
+void variable_set(const char *name, const char *value)
+{
+    variable_assign(name, "=", value);
 }
 
 /*Get variable value (with environment variable fallback)*/
 const char *variable_get(const char *name)
 {
     /*Search in our variables*/
-    for (variable_t *v = vars_head; v; v = v->next)
+    variable_t *v = variable_find(name);
+    if (v)
     {
-        if (strcmp(v->name, name) == 0)
-        {
-            return v->value;
-        }
+        return v->value;
     }
     /*Fallback to environment variables*/
     return getenv(name);
 }
 
-/*Extract variable name from $(VAR), ${VAR}, or $V syntax*/
-static char *extract_var_name(const char *str, size_t *len)
+/*Get the expanded value of a variable, memoized until the next assignment*/
+const char *variable_value(const char *name)
 {
-    /*Handle $(VAR) syntax*/
-    if (str[1] == '(')
+    variable_t *v = variable_find(name);
+    if (!v)
     {
-        const char *end = strchr(str + 2, ')');
-        if (!end)
+        return getenv(name);
+    }
+    if (v->flavor == VAR_SIMPLE)
+    {
+        return v->value;
+    }
+    if (v->memo && v->memo_gen == generation)
+    {
+        return v->memo;
+    }
+    if (v->expanding)
+    {
+        char msg[512];
+        snprintf(msg, sizeof(msg),
+                 "Recursive variable '%s' references itself (eventually)",
+                 v->name);
+        error_exit(msg);
+    }
+    v->expanding = 1;
+    char *expanded = variable_expand(v->value);
+    v->expanding = 0;
+    free(v->memo);
+    v->memo = expanded;
+    v->memo_gen = generation;
+    return v->memo;
+}
+
+/*Find the closing delimiter of a reference, skipping nested ones*/
+static const char *find_closing(const char *str, char open, char close)
+{
+    int depth = 0;
+    for (; *str; str++)
+    {
+        if (*str == open)
         {
-            error_exit("Unterminated variable reference");
+            depth++;
+        }
+        else if (*str == close && depth-- == 0)
+        {
+            return str;
         }
-        *len = end - str + 1;
-        char *name = malloc(end - str - 1);
-        strncpy(name, str + 2, end - str - 2);
-        name[end - str - 2] = '\0';
-        return name;
     }
-    /*Handle ${VAR} syntax*/
-    if (str[1] == '{')
+    return NULL;
+}
+
+/*Extract variable name from $(VAR), ${VAR}, or $V syntax*/
+static char *extract_var_name(const char *str, size_t *len)
+{
+    /*Handle $(VAR) and ${VAR} syntax, which may nest*/
+    if (str[1] == '(' || str[1] == '{')
     {
-        const char *end = strchr(str + 2, '}');
+        char close = str[1] == '(' ? ')' : '}';
+        const char *end = find_closing(str + 2, str[1], close);
         if (!end)
         {
             error_exit("Unterminated variable reference");
         }
         *len = end - str + 1;
         char *name = malloc(end - str - 1);
-        strncpy(name, str + 2, end - str - 2);
+        if (!name)
+        {
+            error_exit("Memory allocation failed");
+        }
+        memcpy(name, str + 2, end - str - 2);
         name[end - str - 2] = '\0';
         return name;
     }
     /*Handle $V syntax (single character)*/
     *len = 2;
     char *name = malloc(2);
+    if (!name)
+    {
+        error_exit("Memory allocation failed");
+    }
     name[0] = str[1];
     name[1] = '\0';
     return name;
 }
 
+/*Expand $(VAR:from=to), replacing the suffix or % pattern of each word*/
+static char *substitution_ref(const char *name)
+{
+    const char *colon = strchr(name, ':');
+    const char *equals = colon ? strchr(colon, '=') : NULL;
+    if (!equals)
+    {
+        return NULL;
+    }
+    char *var = strndup(name, colon - name);
+    char *from = strndup(colon + 1, equals - colon - 1);
+    const char *value = variable_value(var);
+    char *result;
+    if (strchr(from, '%'))
+    {
+        result = patsubst_words(from, equals + 1, value ? value : "");
+    }
+    else
+    {
+        /*Plain form: "from" is a suffix, same as %from=%to*/
+        char *pattern = malloc(strlen(from) + 2);
+        char *replacement = malloc(strlen(equals + 1) + 2);
+        if (!pattern || !replacement)
+        {
+            error_exit("Memory allocation failed");
+        }
+        sprintf(pattern, "%%%s", from);
+        sprintf(replacement, "%%%s", equals + 1);
+        result = patsubst_words(pattern, replacement, value ? value : "");
+        free(pattern);
+        free(replacement);
+    }
+    free(var);
+    free(from);
+    return result;
+}
+
+/*Expand the text of one $(...) reference: function, substitution or var*/
+static char *expand_reference(const char *name)
+{
+    char *result = function_expand(name);
+    if (result)
+    {
+        return result;
+    }
+    char *exp_name = variable_expand(name);
+    result = substitution_ref(exp_name);
+    if (!result)
+    {
+        const char *value = variable_value(exp_name);
+        result = string_duplicate(value ? value : "");
+    }
+    free(exp_name);
+    return result;
+}
+
 /*Recursively expand all variables in a string*/
 char *variable_expand(const char *str)
 {
@@ -106,6 +309,7 @@ char *variable_expand(const char *str)
     {
         return NULL;
     }
+    STATS_INC(expand_calls);
     /*Allocate result buffer*/
     size_t cap = 4096;
     char *result = malloc(cap);
@@ -132,25 +336,21 @@ char *variable_expand(const char *str)
                 src += 2;
                 continue;
             }
-            /*Extract and expand variable name*/
+            /*Extract and expand the reference*/
             size_t var_len;
             char *name = extract_var_name(src, &var_len);
-            char *exp_name = variable_expand(name);
-            const char *value = variable_get(exp_name);
-            /*Insert variable value if found*/
-            if (value)
+            char *value = expand_reference(name);
+            /*Insert its value*/
+            size_t val_len = strlen(value);
+            while (pos + val_len >= cap)
             {
-                size_t val_len = strlen(value);
-                while (pos + val_len >= cap)
-                {
-                    cap *= 2;
-                    result = realloc(result, cap);
-                }
-                strcpy(result + pos, value);
-                pos += val_len;
+                cap *= 2;
+                result = realloc(result, cap);
             }
+            strcpy(result + pos, value);
+            pos += val_len;
             free(name);
-            free(exp_name);
+            free(value);
             src += var_len;
         }
         else
@@ -165,9 +365,170 @@ char *variable_expand(const char *str)
         }
     }
     result[pos] = '\0';
+    STATS_ADD(expand_bytes, pos);
     return result;
 }
 
+/*Mark a variable for export to recipes (export VAR)*/
+void variable_export(const char *name)
+{
+    size_t id = intern(name);
+    if (id >= export_cap)
+    {
+        size_t cap = export_cap ? export_cap : 64;
+        while (cap <= id)
+        {
+            cap *= 2;
+        }
+        export_set = realloc(export_set, cap);
+        if (!export_set)
+        {
+            error_exit("Memory allocation failed");
+        }
+        memset(export_set + export_cap, 0, cap - export_cap);
+        export_cap = cap;
+    }
+    export_set[id] = 1;
+    export_any = 1;
+    env_dirty = 1;
+}
+
+/*Export every variable to recipes (bare export)*/
+void variable_export_all(void)
+{
+    export_all = 1;
+    export_any = 1;
+    env_dirty = 1;
+}
+
+/*Check whether a name can be an environment variable*/
+static int is_env_name(const char *name)
+{
+    if (!isalpha((unsigned char)*name) && *name != '_')
+    {
+        return 0;
+    }
+    for (; *name; name++)
+    {
+        if (!isalnum((unsigned char)*name) && *name != '_')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*Check whether a variable goes to the recipe environment*/
+static int is_exported(const variable_t *v)
+{
+    if (export_all)
+    {
+        return is_env_name(v->name);
+    }
+    size_t id = intern_find(v->name);
+    return id < export_cap && export_set[id];
+}
+
+/*Free the cached environment*/
+static void env_clear(void)
+{
+    for (size_t i = 0; i < env_owned_count; i++)
+    {
+        free(env_owned[i]);
+    }
+    free(env_owned);
+    free(env_cache);
+    env_owned = NULL;
+    env_owned_count = 0;
+    env_cache = NULL;
+}
+
+/*Get the environment for recipes: the inherited one plus exports*/
+char **variable_environ(void)
+{
+    if (!export_any)
+    {
+        return environ;
+    }
+    if (!env_dirty)
+    {
+        return env_cache;
+    }
+    env_clear();
+    size_t inherited = 0;
+    size_t var_count = 0;
+    while (environ[inherited])
+    {
+        inherited++;
+    }
+    for (variable_t *v = vars_head; v; v = v->next)
+    {
+        var_count++;
+    }
+    env_cache = malloc(sizeof(char *) * (inherited + var_count + 1));
+    env_owned = malloc(sizeof(char *) * (var_count ? var_count : 1));
+    if (!env_cache || !env_owned)
+    {
+        error_exit("Memory allocation failed");
+    }
+    /*Exported values first: they hide inherited ones of the same name*/
+    size_t count = 0;
+    for (variable_t *v = vars_head; v; v = v->next)
+    {
+        if (!is_exported(v))
+        {
+            continue;
+        }
+        const char *value = variable_value(v->name);
+        char *entry = malloc(strlen(v->name) + strlen(value) + 2);
+        if (!entry)
+        {
+            error_exit("Memory allocation failed");
+        }
+        sprintf(entry, "%s=%s", v->name, value);
+        env_owned[env_owned_count++] = entry;
+        env_cache[count++] = entry;
+    }
+    for (size_t i = 0; i < inherited; i++)
+    {
+        size_t len = strcspn(environ[i], "=");
+        int hidden = 0;
+        for (size_t j = 0; j < env_owned_count && !hidden; j++)
+        {
+            hidden = strncmp(env_owned[j], environ[i], len + 1) == 0;
+        }
+        if (!hidden)
+        {
+            env_cache[count++] = environ[i];
+        }
+    }
+    env_cache[count] = NULL;
+    env_dirty = 0;
+    return env_cache;
+}
+
+/*Get every variable in definition order (the caller frees the array)*/
+variable_t **variables_all(size_t *count)
+{
+    *count = 0;
+    for (variable_t *v = vars_head; v; v = v->next)
+    {
+        (*count)++;
+    }
+    variable_t **all = malloc(sizeof(variable_t *) * (*count ? *count : 1));
+    if (!all)
+    {
+        error_exit("Memory allocation failed");
+    }
+    /*The list is prepended: fill from the end*/
+    size_t i = *count;
+    for (variable_t *v = vars_head; v; v = v->next)
+    {
+        all[--i] = v;
+    }
+    return all;
+}
+
 /*Free all variables and cleanup memory*/
 void variable_free(void)
 {
@@ -175,8 +536,15 @@ void variable_free(void)
     {
         variable_t *tmp = vars_head;
         vars_head = vars_head->next;
-        free(tmp->name);
         free(tmp->value);
+        free(tmp->memo);
         free(tmp);
     }
+    free(by_name);
+    by_name = NULL;
+    by_name_cap = 0;
+    free(export_set);
+    export_set = NULL;
+    export_cap = 0;
+    env_clear();
 }
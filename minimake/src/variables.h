@@ -1,16 +1,35 @@
 #ifndef VARIABLES_H
 #define VARIABLES_H
 
+#include <stddef.h>
+
+/*Variable flavors*/
+enum var_flavor
+{
+    VAR_RECURSIVE = 0, /*=: expanded at each use*/
+    VAR_SIMPLE /*:=: expanded once at definition*/
+};
+
 typedef struct variable {
-    char *name;
+    const char *name; /*Interned name*/
     char *value;
+    int flavor;
+    char *memo; /*Expansion of a recursive value*/
+    unsigned long memo_gen; /*Generation the memo was computed at*/
+    int expanding; /*Set while expanding, to detect self-reference*/
     struct variable *next;
 } variable_t;
 
 void variable_init(void);
 void variable_set(const char *name, const char *value);
+void variable_assign(const char *name, const char *op, const char *value);
 const char *variable_get(const char *name);
+const char *variable_value(const char *name);
 char *variable_expand(const char *str);
+variable_t **variables_all(size_t *count);
+void variable_export(const char *name);
+void variable_export_all(void);
+char **variable_environ(void);
 void variable_free(void);
 
 #endif /*VARUABLES_H*/
@@ -121,6 +121,434 @@ fi
 
 rm -f test_makefile
 
+# Test 7: Parallel jobs share a jobserver
+echo "Test 7: -j jobserver..."
+cat > test_makefile << 'EOF'
+all: one two
+one:
+	@echo ONE $$MAKEFLAGS
+two:
+	@echo TWO
+EOF
+
+OUTPUT=$($MINIMAKE -j2 -f test_makefile 2>&1)
+if echo "$OUTPUT" | grep -q "ONE.*--jobserver-auth=" \
+    && echo "$OUTPUT" | grep -q "TWO"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 8: -C changes directory before reading the makefile
+echo "Test 8: -C option..."
+mkdir -p test_dir
+cat > test_dir/Makefile << 'EOF'
+here:
+	echo INSIDE
+EOF
+
+OUTPUT=$($MINIMAKE -C test_dir 2>&1)
+if echo "$OUTPUT" | grep -q "INSIDE"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -rf test_dir
+
+# Test 9: Throttled parallel build still runs every recipe
+echo "Test 9: -l and --mem-headroom throttling..."
+cat > test_makefile << 'EOF'
+all: one two
+one:
+	@echo ONE
+two:
+	@echo TWO
+EOF
+
+OUTPUT=$($MINIMAKE -j2 -l 0.01 --mem-headroom=999999999 -f test_makefile 2>&1)
+# A bare -l leaves a goal after it alone; -l<junk> is refused
+GOAL=$($MINIMAKE -l two -f test_makefile 2>&1)
+$MINIMAKE -lfoo -f test_makefile > /dev/null 2>&1
+BAD_RC=$?
+if echo "$OUTPUT" | grep -q "ONE" && echo "$OUTPUT" | grep -q "TWO" \
+    && [ "$GOAL" = "TWO" ] && [ $BAD_RC -eq 2 ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT / $GOAL ($BAD_RC)"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 10: In-process builtin commands behave like the shell
+echo "Test 10: builtin recipe commands..."
+cat > test_makefile << 'EOF'
+all:
+	mkdir -p test_out/sub
+	touch test_out/sub/a
+	cp test_out/sub/a test_out
+	rm -f test_out/sub/a test_out/missing
+	echo BUILTIN   DONE
+	mkdir test_out
+EOF
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+STATUS=$?
+if echo "$OUTPUT" | grep -q "^BUILTIN DONE$" && [ -f test_out/a ] \
+    && [ ! -e test_out/sub/a ] && [ $STATUS -eq 2 ] \
+    && echo "$OUTPUT" | grep -q "File exists"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -rf test_makefile test_out
+
+# Test 11: Built-in functions
+echo "Test 11: wildcard, patsubst and shell functions..."
+mkdir -p test_src
+touch test_src/a.c test_src/b.c
+cat > test_makefile << 'EOF'
+all:
+	@echo $(patsubst %.c,%.o,$(wildcard test_src/*.c)) $(shell echo SH)
+EOF
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+if [ "$OUTPUT" = "test_src/a.o test_src/b.o SH" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -rf test_makefile test_src
+
+# Test 12: Assignment flavors
+echo "Test 12: =, :=, ?= and += assignments..."
+cat > test_makefile << 'EOF'
+B = one
+REC = $(B)
+SIMPLE := $(B)
+DEF ?= default
+DEF ?= ignored
+REC += more
+B = two
+all:
+	@echo $(REC) $(SIMPLE) $(DEF)
+EOF
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+if [ "$OUTPUT" = "two more one default" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 13: Restat prunes dependents of unchanged outputs
+echo "Test 13: --restat and .RESTAT..."
+rm -f .minimake_restat
+cat > test_makefile << 'EOF'
+test_app: test_gen
+	echo RELINK
+test_gen: test_in
+	@echo GENERATING
+EOF
+touch -d '2000-01-01' test_gen
+touch -d '2001-01-01' test_app
+touch test_in
+
+PLAIN=$($MINIMAKE -f test_makefile 2>&1)
+RESTAT=$($MINIMAKE --restat -f test_makefile 2>&1)
+echo ".RESTAT: test_gen" >> test_makefile
+DECLARED=$($MINIMAKE -f test_makefile 2>&1)
+# Same content rewritten: no relink, and the restat log stops the next
+# run from regenerating it
+cat > test_makefile << 'EOF'
+test_app: test_gen
+	echo RELINK
+test_gen: test_in
+	@echo GENERATING; echo same > test_gen
+EOF
+rm -f .minimake_restat
+echo same > test_gen
+touch -d '2000-01-01' test_gen
+touch test_in
+DIGEST=$($MINIMAKE --restat=digest -f test_makefile 2>&1)
+AGAIN=$($MINIMAKE --restat=digest -f test_makefile 2>&1)
+if echo "$PLAIN" | grep -q "RELINK" && ! echo "$RESTAT" | grep -q "RELINK" \
+    && ! echo "$DECLARED" | grep -q "RELINK" \
+    && echo "$DIGEST" | grep -q "GENERATING" \
+    && ! echo "$DIGEST" | grep -q "RELINK" \
+    && ! echo "$AGAIN" | grep -q "GENERATING\|RELINK"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $PLAIN / $RESTAT / $DECLARED / $DIGEST / $AGAIN"
+    ((FAILED++))
+fi
+
+rm -f test_makefile test_app test_gen test_in .minimake_restat
+
+# Test 14: Execution statistics
+echo "Test 14: --stats..."
+cat > test_makefile << 'EOF'
+all:
+	@echo built > /dev/null
+EOF
+
+OUTPUT=$($MINIMAKE --stats=json -f test_makefile 2>&1 >/dev/null)
+TABLE=$($MINIMAKE --stats -f test_makefile 2>&1 >/dev/null)
+if echo "$OUTPUT" | grep -q '"forks": 1' && echo "$TABLE" | grep -q "execution"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 15: Shared dependencies in the target graph
+echo "Test 15: Diamond dependencies..."
+cat > test_makefile << 'EOF'
+all: left right
+	@echo all
+left: base
+	@echo left
+right: base
+	@echo right
+base:
+	@echo base
+EOF
+
+OUTPUT=$($MINIMAKE -j4 -f test_makefile 2>&1)
+if [ "$(echo "$OUTPUT" | grep -cx base)" -eq 1 ] \
+    && [ "$(echo "$OUTPUT" | head -1)" = "base" ] \
+    && [ "$(echo "$OUTPUT" | tail -1)" = "all" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 16: Every .PHONY declaration counts
+echo "Test 16: Multiple .PHONY lines..."
+cat > test_makefile << 'EOF'
+.PHONY: test_clean
+all: test_clean
+	@echo ALL
+.PHONY: all
+test_clean:
+	@echo CLEAN
+EOF
+touch test_clean all
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+if echo "$OUTPUT" | grep -q "CLEAN" && echo "$OUTPUT" | grep -q "ALL"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile test_clean all
+
+# Test 17: Keep going after a failed recipe
+echo "Test 17: -k keep-going..."
+cat > test_makefile << 'EOF'
+all: broken fine
+	@echo ALL
+broken:
+	@false
+fine:
+	@echo FINE
+EOF
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+KEEP=$($MINIMAKE -k -f test_makefile 2>&1)
+KEEP_RC=$?
+if ! echo "$OUTPUT" | grep -q "FINE" && echo "$KEEP" | grep -q "FINE" \
+    && ! echo "$KEEP" | grep -q "ALL" && [ $KEEP_RC -eq 2 ] \
+    && echo "$KEEP" | grep -q "Target 'all' not remade because of errors"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT / $KEEP"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 18: Graph export
+echo "Test 18: -p variables and --export..."
+cat > test_makefile << 'EOF'
+CC = gcc
+CMD = $(CC) -c
+all: dep
+	echo test
+dep:
+EOF
+
+TEXT=$($MINIMAKE -p -f test_makefile 2>&1)
+JSON=$($MINIMAKE --export=json -f test_makefile 2>&1)
+DOT=$($MINIMAKE --export=dot -f test_makefile 2>&1)
+MAGIC=$($MINIMAKE --export=binary -f test_makefile 2>&1 | head -c 4)
+if echo "$TEXT" | grep -q "(CC) = \[gcc\]" \
+    && echo "$JSON" | grep -q '"name":"all","phony":false,"rule":true,"deps":\[1\]' \
+    && echo "$JSON" | grep -qF '"value":"gcc -c","raw":"$(CC) -c"' \
+    && echo "$DOT" | grep -qF '// CMD := gcc -c' \
+    && echo "$DOT" | grep -q '"all" -> "dep";' && [ "$MAGIC" = "MMKG" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $TEXT / $JSON / $DOT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 19: Question mode and dry run
+echo "Test 19: -q and -n..."
+cat > test_makefile << 'EOF'
+test_out: test_in
+	@cp test_in test_out
+EOF
+touch test_in
+
+$MINIMAKE -q -f test_makefile > /dev/null 2>&1
+STALE_RC=$?
+DRY=$($MINIMAKE -n -f test_makefile 2>&1)
+[ -f test_out ] && STALE_RC=99
+$MINIMAKE -f test_makefile > /dev/null 2>&1
+QUIET=$($MINIMAKE -q -f test_makefile 2>&1)
+FRESH_RC=$?
+if [ $STALE_RC -eq 1 ] && [ "$DRY" = "cp test_in test_out" ] \
+    && [ $FRESH_RC -eq 0 ] && [ -z "$QUIET" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $STALE_RC / $DRY / $FRESH_RC / $QUIET"
+    ((FAILED++))
+fi
+
+rm -f test_makefile test_in test_out
+
+# Test 20: Exported variables reach recipes
+echo "Test 20: export..."
+cat > test_makefile << 'EOF'
+GREETING = hello $(NAME)
+NAME = world
+HIDDEN = no
+export GREETING
+export LEVEL := 3
+all:
+	@echo "$$GREETING $$LEVEL [$$HIDDEN]"
+EOF
+
+OUTPUT=$($MINIMAKE -f test_makefile 2>&1)
+if [ "$OUTPUT" = "hello world 3 []" ]; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT"
+    ((FAILED++))
+fi
+
+rm -f test_makefile
+
+# Test 21: Recipe timeouts and termination
+echo "Test 21: --timeout and SIGTERM..."
+cat > test_makefile << 'EOF'
+test_slow:
+	@echo partial > test_slow; sleep 5; echo done >> test_slow
+EOF
+
+START=$(date +%s)
+OUTPUT=$($MINIMAKE --timeout=0.5 -f test_makefile 2>&1)
+TIMEOUT_RC=$?
+[ -f test_slow ] && TIMEOUT_RC=99
+$MINIMAKE -f test_makefile > /dev/null 2>&1 &
+PID=$!
+sleep 0.5
+kill -TERM $PID
+wait $PID
+TERM_RC=$?
+ELAPSED=$(( $(date +%s) - START ))
+if [ $TIMEOUT_RC -eq 2 ] && [ $TERM_RC -eq 143 ] && [ ! -f test_slow ] \
+    && [ $ELAPSED -lt 4 ] && echo "$OUTPUT" | grep -q "Timeout"; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $OUTPUT ($TIMEOUT_RC, $TERM_RC, ${ELAPSED}s)"
+    ((FAILED++))
+fi
+
+rm -f test_makefile test_slow
+
+# Test 22: A timed-out recipe takes its background jobs with it
+echo "Test 22: --timeout kills the whole recipe..."
+cat > test_makefile << 'EOF'
+test_bg:
+	@sleep 30 & echo $$! > test_bgpid; wait
+EOF
+
+# Look before the session ends: a hangup would kill the sleep anyway
+CHECK="$MINIMAKE --timeout=0.5 -f test_makefile; sleep 0.3;"
+CHECK="$CHECK ps -o stat= -p \$(cat test_bgpid)"
+if command -v script > /dev/null; then
+    # Under a terminal, where the recipe is handed the foreground
+    STATE=$(script -qec "$CHECK" /dev/null 2>&1 | tr -d '\r')
+else
+    STATE=$(sh -c "$CHECK" < /dev/null 2>&1)
+fi
+# Orphans may linger as zombies where nothing reaps them
+STATE=$(echo "$STATE" | grep -v "Timeout" | tr -d ' ')
+if [ -f test_bgpid ] && { [ -z "$STATE" ] || [ "${STATE#Z}" != "$STATE" ]; }; then
+    echo "  PASSED"
+    ((PASSED++))
+else
+    echo "  FAILED"
+    echo "  Got: $STATE"
+    ((FAILED++))
+    [ -f test_bgpid ] && kill "$(cat test_bgpid)" 2>/dev/null
+fi
+
+rm -f test_makefile test_bgpid
+
 # Summary
 echo "===== Test Summary ====="
 echo "Passed: $PASSED"